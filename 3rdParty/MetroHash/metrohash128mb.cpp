@@ -0,0 +1,417 @@
+// metrohash128mb.cpp
+//
+// Multi-buffer MetroHash128 for thprac_utils, derived from metrohash128.cpp
+// by J. Andrew Rogers (Apache License, Version 2.0).
+
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "platform.h"
+#include "metrohash128.h"
+#include "metrohash128mb.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define METROHASH_MB_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC emits any intrinsic without per-function opt-in, GCC and Clang need
+// the target attribute to compile the vector kernels in a generic build.
+#if defined(_MSC_VER) && !defined(__clang__)
+#define METROHASH_TARGET_AVX2
+#define METROHASH_TARGET_AVX512
+#else
+#define METROHASH_TARGET_AVX2 __attribute__((target("avx2")))
+#define METROHASH_TARGET_AVX512 __attribute__((target("avx2,avx512f")))
+#endif
+
+static const uint64_t k0 = 0xC83A91E1;
+static const uint64_t k1 = 0x8648DBDB;
+static const uint64_t k2 = 0x7BDEC03B;
+static const uint64_t k3 = 0x2F5870A5;
+
+static const unsigned int max_lanes = 8;
+// Below this many common blocks, moving the state in and out of the vector
+// registers costs more than it saves
+static const uint64_t min_vector_blocks = 16;
+
+// One buffer's hash state between the vector bulk loop and the scalar tail
+struct LaneState
+{
+    const uint8_t * ptr;
+    uint64_t v[4];
+};
+
+
+static void InitLane(LaneState & lane, const uint8_t * buffer, const uint64_t seed)
+{
+    lane.ptr = buffer;
+    lane.v[0] = (static_cast<uint64_t>(seed) - k0) * k3;
+    lane.v[1] = (static_cast<uint64_t>(seed) + k1) * k2;
+    lane.v[2] = (static_cast<uint64_t>(seed) + k0) * k2;
+    lane.v[3] = (static_cast<uint64_t>(seed) - k1) * k3;
+}
+
+
+// Everything MetroHash128::Hash does after the blocks the vector unit
+// already consumed
+static void FinishLane(LaneState & lane, const uint8_t * buffer, const uint64_t length, uint8_t * const hash)
+{
+    const uint8_t * ptr = lane.ptr;
+    const uint8_t * const end = buffer + length;
+    uint64_t * const v = lane.v;
+
+    if (length >= 32)
+    {
+        while ((end - ptr) >= 32)
+        {
+            v[0] += read_u64(ptr) * k0; ptr += 8; v[0] = rotate_right(v[0],29) + v[2];
+            v[1] += read_u64(ptr) * k1; ptr += 8; v[1] = rotate_right(v[1],29) + v[3];
+            v[2] += read_u64(ptr) * k2; ptr += 8; v[2] = rotate_right(v[2],29) + v[0];
+            v[3] += read_u64(ptr) * k3; ptr += 8; v[3] = rotate_right(v[3],29) + v[1];
+        }
+
+        v[2] ^= rotate_right(((v[0] + v[3]) * k0) + v[1], 21) * k1;
+        v[3] ^= rotate_right(((v[1] + v[2]) * k1) + v[0], 21) * k0;
+        v[0] ^= rotate_right(((v[0] + v[2]) * k0) + v[3], 21) * k1;
+        v[1] ^= rotate_right(((v[1] + v[3]) * k1) + v[2], 21) * k0;
+    }
+
+    if ((end - ptr) >= 16)
+    {
+        v[0] += read_u64(ptr) * k2; ptr += 8; v[0] = rotate_right(v[0],33) * k3;
+        v[1] += read_u64(ptr) * k2; ptr += 8; v[1] = rotate_right(v[1],33) * k3;
+        v[0] ^= rotate_right((v[0] * k2) + v[1], 45) * k1;
+        v[1] ^= rotate_right((v[1] * k3) + v[0], 45) * k0;
+    }
+
+    if ((end - ptr) >= 8)
+    {
+        v[0] += read_u64(ptr) * k2; ptr += 8; v[0] = rotate_right(v[0],33) * k3;
+        v[0] ^= rotate_right((v[0] * k2) + v[1], 27) * k1;
+    }
+
+    if ((end - ptr) >= 4)
+    {
+        v[1] += read_u32(ptr) * k2; ptr += 4; v[1] = rotate_right(v[1],33) * k3;
+        v[1] ^= rotate_right((v[1] * k3) + v[0], 46) * k0;
+    }
+
+    if ((end - ptr) >= 2)
+    {
+        v[0] += read_u16(ptr) * k2; ptr += 2; v[0] = rotate_right(v[0],33) * k3;
+        v[0] ^= rotate_right((v[0] * k2) + v[1], 22) * k1;
+    }
+
+    if ((end - ptr) >= 1)
+    {
+        v[1] += read_u8 (ptr) * k2; v[1] = rotate_right(v[1],33) * k3;
+        v[1] ^= rotate_right((v[1] * k3) + v[0], 58) * k0;
+    }
+
+    v[0] += rotate_right((v[0] * k0) + v[1], 13);
+    v[1] += rotate_right((v[1] * k1) + v[0], 37);
+    v[0] += rotate_right((v[0] * k2) + v[1], 13);
+    v[1] += rotate_right((v[1] * k3) + v[0], 37);
+
+    // do any endian conversion here
+
+    memcpy(hash, v, 16);
+}
+
+
+#ifdef METROHASH_MB_X86
+
+// 64-bit multiply by one of k0..k3. They all fit in 32 bits, so two 32x32
+// multiplies do: (hi * 2^32 + lo) * k = lo * k + ((hi * k) << 32)
+METROHASH_TARGET_AVX2 static inline __m256i mul_k_256(const __m256i v, const __m256i k)
+{
+    const __m256i lo = _mm256_mul_epu32(v, k);
+    const __m256i hi = _mm256_mul_epu32(_mm256_srli_epi64(v, 32), k);
+    return _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+}
+
+METROHASH_TARGET_AVX2 static inline __m256i rotate_right_29_256(const __m256i v)
+{
+    return _mm256_or_si256(_mm256_srli_epi64(v, 29), _mm256_slli_epi64(v, 35));
+}
+
+// Loads the 32 byte block at `offset` from each of 4 lanes and transposes
+// them, so that w[i] holds the i-th 64-bit word of every lane
+METROHASH_TARGET_AVX2 static inline void load_block_x4(const uint8_t * const * ptrs, const size_t offset, __m256i w[4])
+{
+    const __m256i r0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptrs[0] + offset));
+    const __m256i r1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptrs[1] + offset));
+    const __m256i r2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptrs[2] + offset));
+    const __m256i r3 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptrs[3] + offset));
+    const __m256i t0 = _mm256_unpacklo_epi64(r0, r1);
+    const __m256i t1 = _mm256_unpackhi_epi64(r0, r1);
+    const __m256i t2 = _mm256_unpacklo_epi64(r2, r3);
+    const __m256i t3 = _mm256_unpackhi_epi64(r2, r3);
+    w[0] = _mm256_permute2x128_si256(t0, t2, 0x20);
+    w[1] = _mm256_permute2x128_si256(t1, t3, 0x20);
+    w[2] = _mm256_permute2x128_si256(t0, t2, 0x31);
+    w[3] = _mm256_permute2x128_si256(t1, t3, 0x31);
+}
+
+METROHASH_TARGET_AVX2 static void BulkAvx2(LaneState * lanes, uint64_t blocks)
+{
+    alignas(32) uint64_t s[4][4];
+    for (unsigned int i = 0; i < 4; i++)
+        for (unsigned int j = 0; j < 4; j++)
+            s[j][i] = lanes[i].v[j];
+
+    __m256i v0 = _mm256_load_si256(reinterpret_cast<const __m256i*>(s[0]));
+    __m256i v1 = _mm256_load_si256(reinterpret_cast<const __m256i*>(s[1]));
+    __m256i v2 = _mm256_load_si256(reinterpret_cast<const __m256i*>(s[2]));
+    __m256i v3 = _mm256_load_si256(reinterpret_cast<const __m256i*>(s[3]));
+    const __m256i vk0 = _mm256_set1_epi32(static_cast<int>(k0));
+    const __m256i vk1 = _mm256_set1_epi32(static_cast<int>(k1));
+    const __m256i vk2 = _mm256_set1_epi32(static_cast<int>(k2));
+    const __m256i vk3 = _mm256_set1_epi32(static_cast<int>(k3));
+
+    // The lane pointers stay put and one offset advances, so the loads
+    // don't wait on pointer updates
+    const uint8_t * const ptrs[4] = { lanes[0].ptr, lanes[1].ptr, lanes[2].ptr, lanes[3].ptr };
+    const size_t bytes = static_cast<size_t>(blocks * 32);
+    for (size_t offset = 0; offset < bytes; offset += 32)
+    {
+        __m256i w[4];
+        load_block_x4(ptrs, offset, w);
+
+        v0 = _mm256_add_epi64(rotate_right_29_256(_mm256_add_epi64(v0, mul_k_256(w[0], vk0))), v2);
+        v1 = _mm256_add_epi64(rotate_right_29_256(_mm256_add_epi64(v1, mul_k_256(w[1], vk1))), v3);
+        v2 = _mm256_add_epi64(rotate_right_29_256(_mm256_add_epi64(v2, mul_k_256(w[2], vk2))), v0);
+        v3 = _mm256_add_epi64(rotate_right_29_256(_mm256_add_epi64(v3, mul_k_256(w[3], vk3))), v1);
+    }
+
+    _mm256_store_si256(reinterpret_cast<__m256i*>(s[0]), v0);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(s[1]), v1);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(s[2]), v2);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(s[3]), v3);
+    for (unsigned int i = 0; i < 4; i++)
+    {
+        lanes[i].ptr += bytes;
+        for (unsigned int j = 0; j < 4; j++)
+            lanes[i].v[j] = s[j][i];
+    }
+}
+
+// GCC's AVX-512 headers start some intrinsics from a self-initialized
+// undefined vector, which -Wmaybe-uninitialized reports wherever they are
+// inlined
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+METROHASH_TARGET_AVX512 static inline __m512i mul_k_512(const __m512i v, const __m512i k)
+{
+    const __m512i lo = _mm512_mul_epu32(v, k);
+    const __m512i hi = _mm512_mul_epu32(_mm512_srli_epi64(v, 32), k);
+    return _mm512_add_epi64(lo, _mm512_slli_epi64(hi, 32));
+}
+
+METROHASH_TARGET_AVX512 static void BulkAvx512(LaneState * lanes, uint64_t blocks)
+{
+    alignas(64) uint64_t s[4][8];
+    for (unsigned int i = 0; i < 8; i++)
+        for (unsigned int j = 0; j < 4; j++)
+            s[j][i] = lanes[i].v[j];
+
+    __m512i v0 = _mm512_load_si512(s[0]);
+    __m512i v1 = _mm512_load_si512(s[1]);
+    __m512i v2 = _mm512_load_si512(s[2]);
+    __m512i v3 = _mm512_load_si512(s[3]);
+    const __m512i vk0 = _mm512_set1_epi32(static_cast<int>(k0));
+    const __m512i vk1 = _mm512_set1_epi32(static_cast<int>(k1));
+    const __m512i vk2 = _mm512_set1_epi32(static_cast<int>(k2));
+    const __m512i vk3 = _mm512_set1_epi32(static_cast<int>(k3));
+
+    const uint8_t * ptrs[8];
+    for (unsigned int i = 0; i < 8; i++) ptrs[i] = lanes[i].ptr;
+    const size_t bytes = static_cast<size_t>(blocks * 32);
+    for (size_t offset = 0; offset < bytes; offset += 32)
+    {
+        __m256i lo[4], hi[4];
+        load_block_x4(ptrs, offset, lo);
+        load_block_x4(ptrs + 4, offset, hi);
+
+        __m512i w[4];
+        for (unsigned int j = 0; j < 4; j++)
+            w[j] = _mm512_inserti64x4(_mm512_castsi256_si512(lo[j]), hi[j], 1);
+
+        v0 = _mm512_add_epi64(_mm512_ror_epi64(_mm512_add_epi64(v0, mul_k_512(w[0], vk0)), 29), v2);
+        v1 = _mm512_add_epi64(_mm512_ror_epi64(_mm512_add_epi64(v1, mul_k_512(w[1], vk1)), 29), v3);
+        v2 = _mm512_add_epi64(_mm512_ror_epi64(_mm512_add_epi64(v2, mul_k_512(w[2], vk2)), 29), v0);
+        v3 = _mm512_add_epi64(_mm512_ror_epi64(_mm512_add_epi64(v3, mul_k_512(w[3], vk3)), 29), v1);
+    }
+
+    _mm512_store_si512(s[0], v0);
+    _mm512_store_si512(s[1], v1);
+    _mm512_store_si512(s[2], v2);
+    _mm512_store_si512(s[3], v3);
+    for (unsigned int i = 0; i < 8; i++)
+    {
+        lanes[i].ptr += bytes;
+        for (unsigned int j = 0; j < 4; j++)
+            lanes[i].v[j] = s[j][i];
+    }
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+static unsigned int DetectLanes()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return 1;
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave) return 1;
+    const unsigned long long xcr0 = _xgetbv(0);
+    if ((xcr0 & 0x6) != 0x6) return 1; // OS saves YMM state
+    __cpuidex(info, 7, 0);
+    if ((info[1] & (1 << 16)) && (xcr0 & 0xe6) == 0xe6) return 8; // AVX-512F, OS saves ZMM state
+    if (info[1] & (1 << 5)) return 4; // AVX2
+    return 1;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return 8;
+    if (__builtin_cpu_supports("avx2")) return 4;
+    return 1;
+#endif
+}
+
+#else
+
+static unsigned int DetectLanes()
+{
+    return 1;
+}
+
+#endif // #ifdef METROHASH_MB_X86
+
+
+unsigned int MetroHash128MB::Lanes()
+{
+    static const unsigned int lanes = DetectLanes();
+    return lanes;
+}
+
+
+void MetroHash128MB::Hash(const uint8_t * const * buffers, const uint64_t * lengths, uint8_t * const * hashes, size_t count, const uint64_t seed)
+{
+    HashLanes(Lanes(), buffers, lengths, hashes, count, seed);
+}
+
+
+void MetroHash128MB::HashLanes(unsigned int lanes, const uint8_t * const * buffers, const uint64_t * lengths, uint8_t * const * hashes, size_t count, const uint64_t seed)
+{
+    lanes = std::min(lanes, Lanes());
+    lanes = lanes >= 8 ? 8 : lanes >= 4 ? 4 : 1;
+
+    if (lanes == 1)
+    {
+        for (size_t i = 0; i < count; i++)
+            MetroHash128::Hash(buffers[i], lengths[i], hashes[i], seed);
+        return;
+    }
+
+    // Longest first, so each group's lanes run out of blocks at about the
+    // same time
+    std::vector<size_t> order(count);
+    for (size_t i = 0; i < count; i++) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return lengths[a] > lengths[b]; });
+
+    for (size_t first = 0; first < count; first += lanes)
+    {
+        const size_t used = std::min<size_t>(lanes, count - first);
+        if (used == 1)
+        {
+            const size_t i = order[first];
+            MetroHash128::Hash(buffers[i], lengths[i], hashes[i], seed);
+            continue;
+        }
+
+        // Blocks every lane has. Unused lanes repeat the first buffer, which
+        // is the longest, and get dropped afterwards.
+        LaneState state[max_lanes];
+        uint64_t blocks = UINT64_MAX;
+        for (size_t l = 0; l < lanes; l++)
+        {
+            const size_t i = order[first + (l < used ? l : 0)];
+            InitLane(state[l], buffers[i], seed);
+            blocks = std::min(blocks, lengths[i] / 32);
+        }
+
+#ifdef METROHASH_MB_X86
+        if (blocks >= min_vector_blocks)
+        {
+            if (lanes == 8)
+                BulkAvx512(state, blocks);
+            else
+                BulkAvx2(state, blocks);
+        }
+#endif
+
+        for (size_t l = 0; l < used; l++)
+        {
+            const size_t i = order[first + l];
+            FinishLane(state[l], buffers[i], lengths[i], hashes[i]);
+        }
+    }
+}
+
+
+bool MetroHash128MB::ImplementationVerified()
+{
+    // Lengths around every tail case, plus a few with many bulk blocks
+    // that differ in length so the groups have uneven lanes
+    std::vector<uint64_t> lengths;
+    for (uint64_t n = 0; n <= 130; n++) lengths.push_back(n);
+    for (uint64_t n = 4000; n < 4100; n += 7) lengths.push_back(n);
+
+    uint64_t total = 0;
+    for (auto n : lengths) total += n;
+    std::vector<uint8_t> data(static_cast<size_t>(total));
+    uint64_t x = 0x9E3779B97F4A7C15;
+    for (auto & b : data)
+    {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        b = static_cast<uint8_t>(x);
+    }
+
+    std::vector<const uint8_t *> buffers;
+    const uint8_t * ptr = data.data();
+    for (auto n : lengths)
+    {
+        buffers.push_back(ptr);
+        ptr += n;
+    }
+
+    std::vector<uint8_t> expected(lengths.size() * 16), actual(lengths.size() * 16);
+    std::vector<uint8_t *> hashes;
+    for (size_t i = 0; i < lengths.size(); i++)
+    {
+        MetroHash128::Hash(buffers[i], lengths[i], &expected[i * 16], 1);
+        hashes.push_back(&actual[i * 16]);
+    }
+
+    const unsigned int widths[] = { 1, 4, 8 };
+    for (auto lanes : widths)
+    {
+        if (lanes > Lanes()) break;
+        memset(actual.data(), 0, actual.size());
+        HashLanes(lanes, buffers.data(), lengths.data(), hashes.data(), lengths.size(), 1);
+        if (memcmp(actual.data(), expected.data(), expected.size()) != 0) return false;
+    }
+
+    return true;
+}
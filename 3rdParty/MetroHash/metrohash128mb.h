@@ -0,0 +1,36 @@
+// metrohash128mb.h
+//
+// Multi-buffer MetroHash128 for thprac_utils, derived from metrohash128.cpp
+// by J. Andrew Rogers (Apache License, Version 2.0).
+//
+// Hashes several independent buffers in lockstep, one buffer per 64-bit
+// vector lane: 4 with AVX2, 8 with AVX-512. The bulk loop of each buffer is
+// run in the vector unit, the tail and finalization are done per buffer.
+// Every hash is bit-identical to MetroHash128::Hash of the same buffer.
+
+#ifndef METROHASH_METROHASH_128_MB_H
+#define METROHASH_METROHASH_128_MB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+class MetroHash128MB
+{
+public:
+    // Widest lane count this CPU supports: 8 (AVX-512), 4 (AVX2) or 1
+    static unsigned int Lanes();
+
+    // Hashes `count` buffers, as many at a time as Lanes() allows. Buffers
+    // of similar length share the vector unit best; the buffers are grouped
+    // by length internally, so the order of the arguments doesn't matter.
+    static void Hash(const uint8_t * const * buffers, const uint64_t * lengths, uint8_t * const * hashes, size_t count, const uint64_t seed=0);
+
+    // Hash() with a fixed lane count of 1, 4 or 8. Falls back to a smaller
+    // count if the CPU can't do it. Meant for benchmarking.
+    static void HashLanes(unsigned int lanes, const uint8_t * const * buffers, const uint64_t * lengths, uint8_t * const * hashes, size_t count, const uint64_t seed=0);
+
+    // Does every lane width match MetroHash128::Hash?
+    static bool ImplementationVerified();
+};
+
+#endif // #ifndef METROHASH_METROHASH_128_MB_H
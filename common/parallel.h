@@ -0,0 +1,25 @@
+#pragma once
+#include <stddef.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// Thread count for `work` units, 0 = one per core
+inline unsigned int ThreadCount(unsigned int numThreads, size_t work)
+{
+    if (!numThreads)
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    return (unsigned int)std::max<size_t>(1, std::min<size_t>(numThreads, work));
+}
+
+// Runs worker(0) .. worker(numThreads - 1), the first one on this thread
+template <typename F>
+void RunThreads(unsigned int numThreads, F worker)
+{
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < numThreads; i++)
+        threads.emplace_back(worker, i);
+    worker(0);
+    for (auto& t : threads)
+        t.join();
+}
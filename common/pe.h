@@ -0,0 +1,223 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// PE/COFF on-disk structures. These mirror the IMAGE_* types from <winnt.h>
+// (same field names) so the signature code doesn't need <Windows.h>.
+// Only the 32-bit optional header is described, since that's what the games
+// are. AddressOfEntryPoint sits at the same offset in PE32+ anyway.
+
+constexpr uint16_t PE_DOS_SIGNATURE = 0x5a4d; // MZ
+constexpr uint32_t PE_NT_SIGNATURE = 0x00004550; // PE\0\0
+constexpr unsigned int PE_SIZEOF_SHORT_NAME = 8;
+constexpr unsigned int PE_NUMBEROF_DIRECTORY_ENTRIES = 16;
+
+// Packed, so PeView can point at headers wherever e_lfanew puts them
+#pragma pack(push, 1)
+struct PeDosHeader {
+    uint16_t e_magic;
+    uint16_t e_cblp;
+    uint16_t e_cp;
+    uint16_t e_crlc;
+    uint16_t e_cparhdr;
+    uint16_t e_minalloc;
+    uint16_t e_maxalloc;
+    uint16_t e_ss;
+    uint16_t e_sp;
+    uint16_t e_csum;
+    uint16_t e_ip;
+    uint16_t e_cs;
+    uint16_t e_lfarlc;
+    uint16_t e_ovno;
+    uint16_t e_res[4];
+    uint16_t e_oemid;
+    uint16_t e_oeminfo;
+    uint16_t e_res2[10];
+    int32_t e_lfanew;
+};
+
+struct PeFileHeader {
+    uint16_t Machine;
+    uint16_t NumberOfSections;
+    uint32_t TimeDateStamp;
+    uint32_t PointerToSymbolTable;
+    uint32_t NumberOfSymbols;
+    uint16_t SizeOfOptionalHeader;
+    uint16_t Characteristics;
+};
+
+struct PeDataDirectory {
+    uint32_t VirtualAddress;
+    uint32_t Size;
+};
+
+struct PeOptionalHeader32 {
+    uint16_t Magic;
+    uint8_t MajorLinkerVersion;
+    uint8_t MinorLinkerVersion;
+    uint32_t SizeOfCode;
+    uint32_t SizeOfInitializedData;
+    uint32_t SizeOfUninitializedData;
+    uint32_t AddressOfEntryPoint;
+    uint32_t BaseOfCode;
+    uint32_t BaseOfData;
+    uint32_t ImageBase;
+    uint32_t SectionAlignment;
+    uint32_t FileAlignment;
+    uint16_t MajorOperatingSystemVersion;
+    uint16_t MinorOperatingSystemVersion;
+    uint16_t MajorImageVersion;
+    uint16_t MinorImageVersion;
+    uint16_t MajorSubsystemVersion;
+    uint16_t MinorSubsystemVersion;
+    uint32_t Win32VersionValue;
+    uint32_t SizeOfImage;
+    uint32_t SizeOfHeaders;
+    uint32_t CheckSum;
+    uint16_t Subsystem;
+    uint16_t DllCharacteristics;
+    uint32_t SizeOfStackReserve;
+    uint32_t SizeOfStackCommit;
+    uint32_t SizeOfHeapReserve;
+    uint32_t SizeOfHeapCommit;
+    uint32_t LoaderFlags;
+    uint32_t NumberOfRvaAndSizes;
+    PeDataDirectory DataDirectory[PE_NUMBEROF_DIRECTORY_ENTRIES];
+};
+
+struct PeNtHeaders32 {
+    uint32_t Signature;
+    PeFileHeader FileHeader;
+    PeOptionalHeader32 OptionalHeader;
+};
+
+struct PeSectionHeader {
+    uint8_t Name[PE_SIZEOF_SHORT_NAME];
+    union {
+        uint32_t PhysicalAddress;
+        uint32_t VirtualSize;
+    } Misc;
+    uint32_t VirtualAddress;
+    uint32_t SizeOfRawData;
+    uint32_t PointerToRawData;
+    uint32_t PointerToRelocations;
+    uint32_t PointerToLinenumbers;
+    uint16_t NumberOfRelocations;
+    uint16_t NumberOfLinenumbers;
+    uint32_t Characteristics;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(PeDosHeader) == 64, "PeDosHeader layout");
+static_assert(sizeof(PeFileHeader) == 20, "PeFileHeader layout");
+static_assert(sizeof(PeOptionalHeader32) == 224, "PeOptionalHeader32 layout");
+static_assert(sizeof(PeNtHeaders32) == 248, "PeNtHeaders32 layout");
+static_assert(sizeof(PeSectionHeader) == 40, "PeSectionHeader layout");
+
+// How the sections are laid out in the span: as stored in the file, or as
+// mapped by the loader (a loaded module, sections at their RVA)
+enum class PeLayout {
+    File,
+    Image,
+};
+
+// Read-only view of a PE file in memory, e.g. a MappedFile. Every access is
+// bounds checked against the span and hands out pointers into it, nothing is
+// copied and no system calls are made. Truncated or malformed headers just
+// leave the view invalid, or make the accessors return nullptr.
+struct PeView {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    PeLayout layout = PeLayout::File;
+    const PeDosHeader* dosHeader = nullptr;
+    const PeNtHeaders32* ntHeaders = nullptr;
+    const PeSectionHeader* sections = nullptr;
+    // Only counts the section headers that are actually inside the span
+    unsigned int numSections = 0;
+
+    PeView() = default;
+    PeView(const void* buffer, size_t bufferSize, PeLayout bufferLayout = PeLayout::File)
+        : data((const uint8_t*)buffer)
+        , size(bufferSize)
+        , layout(bufferLayout)
+    {
+        dosHeader = At<PeDosHeader>(0);
+        if (!dosHeader || dosHeader->e_magic != PE_DOS_SIGNATURE || dosHeader->e_lfanew < 0) {
+            dosHeader = nullptr;
+            return;
+        }
+        auto nt = At<PeNtHeaders32>((uint32_t)dosHeader->e_lfanew);
+        if (!nt || nt->Signature != PE_NT_SIGNATURE)
+            return;
+        ntHeaders = nt;
+
+        uint64_t sectionsOffset = (uint64_t)(uint32_t)dosHeader->e_lfanew + offsetof(PeNtHeaders32, OptionalHeader) + nt->FileHeader.SizeOfOptionalHeader;
+        numSections = nt->FileHeader.NumberOfSections;
+        if (sectionsOffset >= size)
+            numSections = 0;
+        else if (numSections > (size - sectionsOffset) / sizeof(PeSectionHeader))
+            numSections = (unsigned int)((size - sectionsOffset) / sizeof(PeSectionHeader));
+        sections = numSections ? At<PeSectionHeader>(sectionsOffset, numSections) : nullptr;
+    }
+
+    bool IsValid() const { return ntHeaders != nullptr; }
+
+    // `count` consecutive T's at `offset`, or nullptr if they don't fit
+    template <typename T>
+    const T* At(uint64_t offset, size_t count = 1) const
+    {
+        if (offset > size || count > (size - offset) / sizeof(T))
+            return nullptr;
+        return reinterpret_cast<const T*>(data + offset);
+    }
+
+    // Section headers with an 8 byte name field aren't null terminated
+    static bool SectionNameIs(const PeSectionHeader& section, const char* name)
+    {
+        return !strncmp((const char*)section.Name, name, PE_SIZEOF_SHORT_NAME);
+    }
+
+    const PeSectionHeader* FindSection(const char* name) const
+    {
+        for (unsigned int i = 0; i < numSections; i++) {
+            if (SectionNameIs(sections[i], name))
+                return &sections[i];
+        }
+        return nullptr;
+    }
+
+    // Bytes of a section that read the same in the file and in a loaded
+    // image: the raw data, minus the file alignment padding past VirtualSize
+    static uint32_t SectionDataSize(const PeSectionHeader& section)
+    {
+        uint32_t virtualSize = section.Misc.VirtualSize;
+        return virtualSize && virtualSize < section.SizeOfRawData ? virtualSize : section.SizeOfRawData;
+    }
+
+    // Offset of the section's data in the span, depending on the layout
+    uint64_t SectionDataOffset(const PeSectionHeader& section) const
+    {
+        return layout == PeLayout::Image ? section.VirtualAddress : section.PointerToRawData;
+    }
+
+    // The SectionDataSize() bytes of `section`, or nullptr if they don't fit
+    const uint8_t* SectionData(const PeSectionHeader& section) const
+    {
+        return At<uint8_t>(SectionDataOffset(section), SectionDataSize(section));
+    }
+
+    // Offset of `rva` in the span, or UINT64_MAX if no section maps it
+    uint64_t RvaToOffset(uint32_t rva) const
+    {
+        if (layout == PeLayout::Image)
+            return rva;
+        for (unsigned int i = 0; i < numSections; i++) {
+            const PeSectionHeader& section = sections[i];
+            uint32_t extent = section.Misc.VirtualSize > section.SizeOfRawData ? section.Misc.VirtualSize : section.SizeOfRawData;
+            if (rva >= section.VirtualAddress && rva - section.VirtualAddress < extent)
+                return (uint64_t)section.PointerToRawData + (rva - section.VirtualAddress);
+        }
+        return UINT64_MAX;
+    }
+};
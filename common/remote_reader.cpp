@@ -0,0 +1,256 @@
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include "remote_reader.h"
+#ifndef _WIN32
+#include <limits.h>
+#include <sys/uio.h>
+#endif
+
+RemoteReader::RemoteReader(uint32_t pid)
+    : pid(pid)
+{
+#ifdef _WIN32
+    process = OpenProcess(PROCESS_VM_READ | PROCESS_QUERY_INFORMATION, FALSE, pid);
+#endif
+}
+
+RemoteReader::~RemoteReader()
+{
+#ifdef _WIN32
+    if (process)
+        CloseHandle(process);
+#endif
+}
+
+bool RemoteReader::IsOpen() const
+{
+#ifdef _WIN32
+    return process != NULL;
+#else
+    return true;
+#endif
+}
+
+void RemoteReader::Add(uint64_t address, void* buffer, size_t size)
+{
+    if (size)
+        queue.push_back({ address, buffer, size });
+}
+
+void RemoteReader::Invalidate()
+{
+    cache.clear();
+    cacheOrder.clear();
+}
+
+bool RemoteReader::EnumRegions(std::vector<RemoteRegion>& regionsOut) const
+{
+    regionsOut.clear();
+#ifdef _WIN32
+    if (!process)
+        return false;
+    MEMORY_BASIC_INFORMATION info;
+    for (uintptr_t address = 0; VirtualQueryEx(process, (LPCVOID)address, &info, sizeof(info)) == sizeof(info);) {
+        uintptr_t next = (uintptr_t)info.BaseAddress + info.RegionSize;
+        if (info.State == MEM_COMMIT && !(info.Protect & (PAGE_GUARD | PAGE_NOACCESS))) {
+            bool writable = (info.Protect & (PAGE_READWRITE | PAGE_WRITECOPY | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY)) != 0;
+            regionsOut.push_back({ (uint64_t)(uintptr_t)info.BaseAddress, (uint64_t)info.RegionSize, writable });
+        }
+        if (next <= address)
+            break;
+        address = next;
+    }
+    return true;
+#else
+    char mapsFn[64];
+    snprintf(mapsFn, sizeof(mapsFn), "/proc/%u/maps", pid);
+    FILE* maps = fopen(mapsFn, "r");
+    if (!maps)
+        return false;
+
+    char line[4096];
+    while (fgets(line, sizeof(line), maps)) {
+        unsigned long long start, end;
+        char perms[5];
+        int pathStart = 0;
+        if (sscanf(line, "%llx-%llx %4s %*s %*s %*s %n", &start, &end, perms, &pathStart) < 3 || perms[0] != 'r')
+            continue;
+        // Kernel pages that process_vm_readv can't read
+        if (pathStart && (!strncmp(line + pathStart, "[vvar]", 6) || !strncmp(line + pathStart, "[vsyscall]", 10)))
+            continue;
+        regionsOut.push_back({ start, end - start, perms[1] == 'w' });
+    }
+    fclose(maps);
+    return true;
+#endif
+}
+
+const uint8_t* RemoteReader::CachedPage(uint64_t page) const
+{
+    auto it = cache.find(page);
+    return it == cache.end() ? nullptr : it->second.get();
+}
+
+void RemoteReader::CachePage(uint64_t page, const uint8_t* data)
+{
+    auto& slot = cache[page];
+    if (!slot) {
+        if (cacheOrder.size() >= CACHE_PAGES) {
+            cache.erase(cacheOrder.front());
+            cacheOrder.pop_front();
+        }
+        slot.reset(new uint8_t[READ_PAGE_SIZE]);
+        cacheOrder.push_back(page);
+    }
+    memcpy(slot.get(), data, READ_PAGE_SIZE);
+}
+
+// Fills in every run, marking the ones that couldn't be read
+void RemoteReader::ReadRuns(std::vector<Run>& runs)
+{
+#ifdef _WIN32
+    for (auto& run : runs) {
+        SIZE_T bytesRead = 0;
+        run.ok = process && ReadProcessMemory(process, (LPCVOID)(uintptr_t)run.address, run.buffer, run.size, &bytesRead) && bytesRead == run.size;
+        lastBatch.syscalls++;
+        lastBatch.bytesRead += bytesRead;
+    }
+#else
+    // process_vm_readv stops at the first remote range that faults. The
+    // ranges before it were read, so skip past the bad one and go again.
+    std::vector<iovec> local, remote;
+    for (size_t first = 0; first < runs.size();) {
+        size_t count = std::min<size_t>(runs.size() - first, IOV_MAX);
+        local.clear();
+        remote.clear();
+        for (size_t i = first; i < first + count; i++) {
+            local.push_back({ runs[i].buffer, runs[i].size });
+            remote.push_back({ (void*)(uintptr_t)runs[i].address, runs[i].size });
+        }
+        ssize_t result = process_vm_readv((pid_t)pid, local.data(), count, remote.data(), count, 0);
+        lastBatch.syscalls++;
+        size_t bytesRead = result > 0 ? (size_t)result : 0;
+        lastBatch.bytesRead += bytesRead;
+        size_t i = first;
+        for (; i < first + count && bytesRead >= runs[i].size; i++) {
+            runs[i].ok = true;
+            bytesRead -= runs[i].size;
+        }
+        if (i < first + count) {
+            runs[i].ok = false;
+            i++;
+        }
+        first = i;
+    }
+#endif
+}
+
+bool RemoteReader::Flush()
+{
+    lastBatch = {};
+    lastBatch.requests = queue.size();
+
+    // Pages the small requests need that aren't cached yet, and the large
+    // requests as they are
+    std::vector<uint64_t> missingPages;
+    std::vector<Run> runs;
+    for (auto& request : queue) {
+        if (request.size > CACHED_READ_LIMIT) {
+            runs.push_back({ request.address, (uint8_t*)request.buffer, request.size, false });
+            continue;
+        }
+        uint64_t firstPage = request.address / READ_PAGE_SIZE;
+        uint64_t lastPage = (request.address + request.size - 1) / READ_PAGE_SIZE;
+        bool hit = true;
+        for (uint64_t page = firstPage; page <= lastPage; page++) {
+            if (!CachedPage(page)) {
+                missingPages.push_back(page);
+                hit = false;
+            }
+        }
+        lastBatch.cacheHits += hit;
+    }
+
+    // Adjacent missing pages become one run into a staging buffer
+    std::sort(missingPages.begin(), missingPages.end());
+    missingPages.erase(std::unique(missingPages.begin(), missingPages.end()), missingPages.end());
+    std::vector<uint8_t> staging(missingPages.size() * READ_PAGE_SIZE);
+    size_t directRuns = runs.size();
+    for (size_t i = 0; i < missingPages.size();) {
+        size_t j = i + 1;
+        while (j < missingPages.size() && missingPages[j] == missingPages[j - 1] + 1)
+            j++;
+        runs.push_back({ missingPages[i] * READ_PAGE_SIZE, staging.data() + i * READ_PAGE_SIZE, (j - i) * READ_PAGE_SIZE, false });
+        i = j;
+    }
+    ReadRuns(runs);
+
+    bool ok = true;
+    for (size_t i = 0; i < directRuns; i++)
+        ok &= runs[i].ok;
+    // A fault anywhere in a run fails all of it. Retry its pages one by one,
+    // so one unmapped page doesn't take the pages next to it down too.
+    std::vector<Run> retries;
+    for (size_t i = directRuns; i < runs.size(); i++) {
+        if (runs[i].ok || runs[i].size == READ_PAGE_SIZE)
+            continue;
+        for (size_t offset = 0; offset < runs[i].size; offset += READ_PAGE_SIZE)
+            retries.push_back({ runs[i].address + offset, runs[i].buffer + offset, READ_PAGE_SIZE, false });
+    }
+    if (!retries.empty())
+        ReadRuns(retries);
+    std::vector<char> pageOk(missingPages.size());
+    auto markPages = [&](const Run& run) {
+        if (run.ok)
+            std::fill_n(pageOk.begin() + (run.buffer - staging.data()) / READ_PAGE_SIZE, run.size / READ_PAGE_SIZE, 1);
+    };
+    for (size_t i = directRuns; i < runs.size(); i++)
+        markPages(runs[i]);
+    for (auto& run : retries)
+        markPages(run);
+
+    auto batchPage = [&](uint64_t page) -> const uint8_t* {
+        auto it = std::lower_bound(missingPages.begin(), missingPages.end(), page);
+        if (it == missingPages.end() || *it != page)
+            return CachedPage(page);
+        size_t index = it - missingPages.begin();
+        return pageOk[index] ? staging.data() + index * READ_PAGE_SIZE : nullptr;
+    };
+
+    for (auto& request : queue) {
+        if (request.size > CACHED_READ_LIMIT)
+            continue;
+        uint8_t* out = (uint8_t*)request.buffer;
+        for (uint64_t address = request.address; address < request.address + request.size;) {
+            size_t offset = (size_t)(address % READ_PAGE_SIZE);
+            size_t size = (size_t)std::min<uint64_t>(READ_PAGE_SIZE - offset, request.address + request.size - address);
+            const uint8_t* data = batchPage(address / READ_PAGE_SIZE);
+            if (!data) {
+                ok = false;
+                break;
+            }
+            memcpy(out, data + offset, size);
+            out += size;
+            address += size;
+        }
+    }
+    // Cached last, so evictions can't drop pages the requests above needed
+    for (size_t i = 0; i < missingPages.size(); i++) {
+        if (pageOk[i])
+            CachePage(missingPages[i], staging.data() + i * READ_PAGE_SIZE);
+    }
+    queue.clear();
+
+    total.requests += lastBatch.requests;
+    total.cacheHits += lastBatch.cacheHits;
+    total.syscalls += lastBatch.syscalls;
+    total.bytesRead += lastBatch.bytesRead;
+    if (batchLog) {
+        fprintf(batchLog, "batch: %zu reads, %zu from cache, %zu syscalls, %llu bytes\n",
+            lastBatch.requests, lastBatch.cacheHits, lastBatch.syscalls, (unsigned long long)lastBatch.bytesRead);
+    }
+    if (!ok)
+        errno = EFAULT;
+    return ok;
+}
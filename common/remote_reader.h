@@ -0,0 +1,87 @@
+#pragma once
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+struct RemoteRegion {
+    uint64_t address;
+    uint64_t size;
+    bool writable;
+};
+
+// Reads another process's memory in batches. Reads are queued with Add()
+// and all issued by Flush(): one process_vm_readv per batch on Linux, one
+// ReadProcessMemory per run of adjacent pages on Windows. Small reads go
+// through a page-granular cache, so reading the same headers again doesn't
+// cost a system call. Large reads bypass it and land in the caller's buffer
+// directly.
+struct RemoteReader {
+    static constexpr size_t READ_PAGE_SIZE = 0x1000;
+    // Reads of up to this many bytes are served from the page cache
+    static constexpr size_t CACHED_READ_LIMIT = 2 * READ_PAGE_SIZE;
+    static constexpr size_t CACHE_PAGES = 64;
+
+    struct Stats {
+        size_t requests = 0;
+        size_t cacheHits = 0;
+        size_t syscalls = 0;
+        uint64_t bytesRead = 0;
+    };
+    // Counts of the last Flush(), and of all of them
+    Stats lastBatch;
+    Stats total;
+    // If set, every Flush() writes its counts here
+    FILE* batchLog = nullptr;
+
+    RemoteReader(uint32_t pid);
+    ~RemoteReader();
+    RemoteReader(const RemoteReader&) = delete;
+    RemoteReader& operator=(const RemoteReader&) = delete;
+
+    bool IsOpen() const;
+    void Add(uint64_t address, void* buffer, size_t size);
+    // Issues every queued read. Returns false if any of them failed, the
+    // buffers of the ones that succeeded are filled in regardless.
+    bool Flush();
+    bool Read(uint64_t address, void* buffer, size_t size)
+    {
+        Add(address, buffer, size);
+        return Flush();
+    }
+    // Forgets the cached pages, e.g. after the process ran for a while
+    void Invalidate();
+    // The readable memory of the process, sorted by address
+    bool EnumRegions(std::vector<RemoteRegion>& regionsOut) const;
+
+private:
+    struct Request {
+        uint64_t address;
+        void* buffer;
+        size_t size;
+    };
+    struct Run {
+        uint64_t address;
+        uint8_t* buffer;
+        size_t size;
+        bool ok;
+    };
+
+    uint32_t pid;
+#ifdef _WIN32
+    HANDLE process = NULL;
+#endif
+    std::vector<Request> queue;
+    std::unordered_map<uint64_t, std::unique_ptr<uint8_t[]>> cache;
+    std::deque<uint64_t> cacheOrder;
+
+    void ReadRuns(std::vector<Run>& runs);
+    const uint8_t* CachedPage(uint64_t page) const;
+    void CachePage(uint64_t page, const uint8_t* data);
+};
@@ -0,0 +1,30 @@
+#include <stdint.h>
+#include "simd.h"
+
+static bool DetectAvx2()
+{
+#if !defined(SIMD_X86)
+    return false;
+#elif defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    if (!(info[2] & (1 << 27))) // OSXSAVE
+        return false;
+    if ((_xgetbv(0) & 0x6) != 0x6) // OS saves YMM state
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+bool SimdHasAvx2()
+{
+    static const bool hasAvx2 = DetectAvx2();
+    return hasAvx2;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <stdint.h>
+
+// Runtime dispatch for the hand vectorized paths. The kernels are compiled
+// into every build and only run when the CPU has the instructions.
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define SIMD_X86
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// MSVC emits any intrinsic without per-function opt-in, GCC and Clang need
+// the target attribute to compile AVX2 code in a generic build.
+#if defined(_MSC_VER) && !defined(__clang__)
+#define SIMD_TARGET_AVX2
+#else
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+bool SimdHasAvx2();
+
+// Index of the lowest set bit, `mask` must not be 0
+inline unsigned int SimdLowestBit(uint32_t mask)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return (unsigned int)__builtin_ctz(mask);
+#endif
+}
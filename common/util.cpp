@@ -1,12 +1,14 @@
-#include <Windows.h>
 #include <stdlib.h>
 #include "util.h"
+
+#ifdef _WIN32
 #include "window.h"
 
 static void* _str_cvt_buffer(size_t size)
 {
-    static size_t bufferSize = 512;
-    static void* bufferPtr = nullptr;
+    // Per thread, the batch tools convert paths from worker threads
+    static thread_local size_t bufferSize = 512;
+    static thread_local void* bufferPtr = nullptr;
     if (!bufferPtr) {
         bufferPtr = malloc(bufferSize);
     }
@@ -16,7 +18,7 @@ static void* _str_cvt_buffer(size_t size)
         if (bufferPtr) {
             free(bufferPtr);
         }
-        bufferPtr = malloc(size);
+        bufferPtr = malloc(bufferSize);
     }
     return bufferPtr;
 }
@@ -30,7 +32,7 @@ std::string utf16_to_utf8(const wchar_t* utf16)
 std::wstring utf8_to_utf16(const char* utf8)
 {
     int utf16Length = MultiByteToWideChar(CP_UTF8, 0, utf8, -1, nullptr, 0);
-    wchar_t* utf16 = (wchar_t*)_str_cvt_buffer(utf16Length);
+    wchar_t* utf16 = (wchar_t*)_str_cvt_buffer(utf16Length * sizeof(wchar_t));
     MultiByteToWideChar(CP_UTF8, 0, utf8, -1, utf16, utf16Length);
     return std::wstring(utf16);
 }
@@ -47,4 +49,98 @@ const char* OpenFileDialog(const wchar_t* filter) {
     if (!GetOpenFileNameW(&ofn))
         return NULL;
     return _strdup(utf16_to_utf8(fn).c_str());
-}
\ No newline at end of file
+}
+#endif
+
+FILE* OpenFileUtf8(const char* fn, const char* mode)
+{
+#ifdef _WIN32
+    FILE* fp = NULL;
+    if (_wfopen_s(&fp, utf8_to_utf16(fn).c_str(), utf8_to_utf16(mode).c_str()))
+        return NULL;
+    return fp;
+#else
+    return fopen(fn, mode);
+#endif
+}
+
+WindowedFile::WindowedFile(const char* fn)
+{
+#ifdef _WIN32
+    hFile = CreateFileW(utf8_to_utf16(fn).c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(hFile, &size) || !size.QuadPart) {
+        return;
+    }
+    fileMap = CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (fileMap) {
+        fileSize = (uint64_t)size.QuadPart;
+    }
+#else
+    fd = open(fn, O_RDONLY);
+    if (fd == -1) {
+        return;
+    }
+    struct stat st;
+    if (!fstat(fd, &st)) {
+        fileSize = (uint64_t)st.st_size;
+    }
+#endif
+}
+
+WindowedFile::~WindowedFile()
+{
+#ifdef _WIN32
+    if (windowView)
+        UnmapViewOfFile(windowView);
+    if (fileMap)
+        CloseHandle(fileMap);
+    if (hFile != INVALID_HANDLE_VALUE)
+        CloseHandle(hFile);
+#else
+    if (windowView)
+        munmap(windowView, windowSize);
+    if (fd != -1)
+        close(fd);
+#endif
+}
+
+const uint8_t* WindowedFile::Map(uint64_t offset, size_t size)
+{
+    if (!size || offset > fileSize || size > fileSize - offset)
+        return NULL;
+    if (windowView && offset >= windowOffset && offset + size <= windowOffset + windowSize)
+        return (const uint8_t*)windowView + (offset - windowOffset);
+
+#ifdef _WIN32
+    static const uint64_t granularity = []() {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        return (uint64_t)si.dwAllocationGranularity;
+    }();
+#else
+    static const uint64_t granularity = (uint64_t)sysconf(_SC_PAGESIZE);
+#endif
+    uint64_t alignedOffset = offset - offset % granularity;
+    size_t alignedSize = (size_t)(offset - alignedOffset) + size;
+
+#ifdef _WIN32
+    if (windowView)
+        UnmapViewOfFile(windowView);
+    windowView = MapViewOfFile(fileMap, FILE_MAP_READ, (DWORD)(alignedOffset >> 32), (DWORD)alignedOffset, alignedSize);
+#else
+    if (windowView)
+        munmap(windowView, windowSize);
+    windowView = mmap(NULL, alignedSize, PROT_READ, MAP_PRIVATE, fd, (off_t)alignedOffset);
+    if (windowView == MAP_FAILED)
+        windowView = NULL;
+#endif
+    if (!windowView)
+        return NULL;
+    windowOffset = alignedOffset;
+    windowSize = alignedSize;
+    return (const uint8_t*)windowView + (offset - windowOffset);
+}
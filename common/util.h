@@ -1,67 +1,157 @@
-#pragma once
-#include <Windows.h>
-#include <string>
-
-std::string utf16_to_utf8(const wchar_t* utf16);
-std::wstring utf8_to_utf16(const char* utf8);
-const char* OpenFileDialog(const wchar_t* filter);
-
-struct MappedFile {
-    HANDLE fileMap = NULL;
-    HANDLE hFile = INVALID_HANDLE_VALUE;
-    size_t fileSize = 0;
-    void* fileMapView = NULL;
-
-    MappedFile(const wchar_t* fn)
-    {
-        hFile = CreateFileW(fn, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-        if (hFile == INVALID_HANDLE_VALUE) {
-            return;
-        }
-        fileSize = GetFileSize(hFile, NULL);
-        fileMap = CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, fileSize, NULL);
-        if (fileMap == NULL) {
-            CloseHandle(hFile);
-            return;
-        }
-        fileMapView = MapViewOfFile(fileMap, FILE_MAP_READ, 0, 0, fileSize);
-        if (!fileMapView) {
-            CloseHandle(hFile);
-            CloseHandle(fileMap);
-            return;
-        }
-    }
-    ~MappedFile()
-    {
-        UnmapViewOfFile(fileMapView);
-        CloseHandle(fileMap);
-        CloseHandle(hFile);
-    }
-};
-
-/// defer implementation for C++
-/// http://www.gingerbill.org/article/defer-in-cpp.html
-/// ----------------------------
-
-// Fun fact: in the vast majority of cases the compiler
-// optimizes this down to normal conditional branching.
-template <typename F>
-struct privDefer {
-    F f;
-    explicit privDefer(F f)
-        : f(f)
-    {
-    }
-    ~privDefer() { f(); }
-};
-
-template <typename F>
-privDefer<F> defer_func(F f)
-{
-    return privDefer<F>(f);
-}
-
-#define DEFER_1(x, y) x##y
-#define DEFER_2(x, y) DEFER_1(x, y)
-#define DEFER_3(x) DEFER_2(x, __COUNTER__)
+#pragma once
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+#ifdef _WIN32
+std::string utf16_to_utf8(const wchar_t* utf16);
+std::wstring utf8_to_utf16(const char* utf8);
+const char* OpenFileDialog(const wchar_t* filter);
+#endif
+FILE* OpenFileUtf8(const char* fn, const char* mode);
+
+// Value of a hex digit, -1 if `c` isn't one
+inline int HexDigit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// With `copyOnWrite` the view can be written to. Writes stay private to
+// the process and never reach the file.
+struct MappedFile {
+#ifdef _WIN32
+    HANDLE fileMap = NULL;
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+#else
+    int fd = -1;
+#endif
+    size_t fileSize = 0;
+    void* fileMapView = NULL;
+
+#ifdef _WIN32
+    MappedFile(const wchar_t* fn, bool copyOnWrite = false)
+    {
+        hFile = CreateFileW(fn, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hFile == INVALID_HANDLE_VALUE) {
+            return;
+        }
+        fileSize = GetFileSize(hFile, NULL);
+        fileMap = CreateFileMappingW(hFile, NULL, copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, fileSize, NULL);
+        if (fileMap == NULL) {
+            CloseHandle(hFile);
+            return;
+        }
+        fileMapView = MapViewOfFile(fileMap, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, fileSize);
+        if (!fileMapView) {
+            CloseHandle(hFile);
+            CloseHandle(fileMap);
+            return;
+        }
+    }
+    MappedFile(const char* fn, bool copyOnWrite = false)
+        : MappedFile(utf8_to_utf16(fn).c_str(), copyOnWrite)
+    {
+    }
+    ~MappedFile()
+    {
+        UnmapViewOfFile(fileMapView);
+        CloseHandle(fileMap);
+        CloseHandle(hFile);
+    }
+#else
+    MappedFile(const char* fn, bool copyOnWrite = false)
+    {
+        fd = open(fn, O_RDONLY);
+        if (fd == -1) {
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) || !st.st_size) {
+            return;
+        }
+        fileSize = (size_t)st.st_size;
+        void* view = mmap(NULL, fileSize, copyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view == MAP_FAILED) {
+            fileSize = 0;
+            return;
+        }
+        fileMapView = view;
+    }
+    ~MappedFile()
+    {
+        if (fileMapView)
+            munmap(fileMapView, fileSize);
+        if (fd != -1)
+            close(fd);
+    }
+#endif
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+};
+
+// Like MappedFile, but only ever maps one window of the file at a time.
+// Lets files of any size be read with bounded address space use, which
+// matters for the Win32 build.
+struct WindowedFile {
+#ifdef _WIN32
+    HANDLE fileMap = NULL;
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+#else
+    int fd = -1;
+#endif
+    uint64_t fileSize = 0;
+    void* windowView = NULL;
+    uint64_t windowOffset = 0;
+    size_t windowSize = 0;
+
+    WindowedFile(const char* fn);
+    ~WindowedFile();
+    WindowedFile(const WindowedFile&) = delete;
+    WindowedFile& operator=(const WindowedFile&) = delete;
+
+    // Returns a pointer to [offset, offset + size) of the file, or NULL if
+    // that's out of range. Stays valid until the next call that needs a
+    // different window.
+    const uint8_t* Map(uint64_t offset, size_t size);
+};
+
+/// defer implementation for C++
+/// http://www.gingerbill.org/article/defer-in-cpp.html
+/// ----------------------------
+
+// Fun fact: in the vast majority of cases the compiler
+// optimizes this down to normal conditional branching.
+template <typename F>
+struct privDefer {
+    F f;
+    explicit privDefer(F f)
+        : f(f)
+    {
+    }
+    ~privDefer() { f(); }
+};
+
+template <typename F>
+privDefer<F> defer_func(F f)
+{
+    return privDefer<F>(f);
+}
+
+#define DEFER_1(x, y) x##y
+#define DEFER_2(x, y) DEFER_1(x, y)
+#define DEFER_3(x) DEFER_2(x, __COUNTER__)
 #define defer(code) auto DEFER_3(_defer_) = defer_func([&]() { code; })
\ No newline at end of file
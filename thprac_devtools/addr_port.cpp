@@ -0,0 +1,305 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <util.h>
+#include <pe.h>
+#include "addr_port.h"
+
+constexpr char PORT_INDEX_MAGIC[4] = { 'T', 'P', 'R', 'T' };
+constexpr uint32_t PORT_INDEX_VERSION = 1;
+// Window hashes kept, 1 in PORT_SAMPLE_RATE
+constexpr uint64_t PORT_SAMPLE_RATE = 8;
+// Anchors are looked for this far around an address first, then 4 times
+// farther each round up to PORT_MAX_RADIUS
+constexpr uint32_t PORT_MIN_RADIUS = 256;
+constexpr uint32_t PORT_MAX_RADIUS = 16384;
+// Fewer agreeing anchors than this lower the confidence
+constexpr uint32_t PORT_FULL_VOTES = 4;
+
+bool ReadPortText(const char* fn, PortText& textOut, bool headersOnly)
+{
+    MappedFile file(fn);
+    if (!file.fileMapView)
+        return false;
+    PeView exe(file.fileMapView, file.fileSize);
+    if (!exe.IsValid())
+        return false;
+    const PeSectionHeader* text = exe.FindSection(".text");
+    const uint8_t* data = text ? exe.SectionData(*text) : nullptr;
+    if (!data)
+        return false;
+    const uint32_t imageBase = exe.ntHeaders->OptionalHeader.ImageBase;
+    const uint32_t imageSize = exe.ntHeaders->OptionalHeader.SizeOfImage;
+    textOut.address = (uint64_t)imageBase + text->VirtualAddress;
+    textOut.timeStamp = exe.ntHeaders->FileHeader.TimeDateStamp;
+    textOut.size = PeView::SectionDataSize(*text);
+    textOut.bytes.clear();
+    if (headersOnly)
+        return true;
+
+    const size_t size = textOut.size;
+    textOut.bytes.assign(data, data + size);
+    uint8_t* bytes = textOut.bytes.data();
+    auto clear = [&](size_t offset, size_t count) {
+        if (offset < size)
+            memset(bytes + offset, 0, std::min(count, size - offset));
+    };
+    for (size_t i = 0; i < size; i++) {
+        uint8_t op = data[i];
+        if (op == 0xe8 || op == 0xe9) // call/jmp rel32
+            clear(i + 1, 4);
+        else if (op == 0x0f && i + 1 < size && (data[i + 1] & 0xf0) == 0x80) // jcc rel32
+            clear(i + 2, 4);
+        else if (op == 0xeb || (op & 0xf0) == 0x70) // jmp/jcc rel8
+            clear(i + 1, 1);
+        if (i + 4 <= size) {
+            uint32_t value;
+            memcpy(&value, data + i, sizeof(value));
+            if (value - imageBase < imageSize)
+                clear(i, 4);
+        }
+    }
+    return true;
+}
+
+// Finalizer of MurmurHash3, spreads the polynomial hash over all bits
+static uint64_t MixHash(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+struct PortWindow {
+    uint64_t hash;
+    uint32_t offset;
+};
+
+// Rabin-Karp over every PORT_WINDOW bytes, keeping the sampled windows.
+// Sorted by hash.
+static std::vector<PortWindow> HashWindows(const std::vector<uint8_t>& bytes)
+{
+    constexpr uint64_t PRIME = 0x100000001b3ull;
+    std::vector<PortWindow> windows;
+    if (bytes.size() < PORT_WINDOW)
+        return windows;
+    uint64_t outFactor = 1; // PRIME ^ (PORT_WINDOW - 1)
+    for (uint32_t i = 1; i < PORT_WINDOW; i++)
+        outFactor *= PRIME;
+    uint64_t hash = 0;
+    for (uint32_t i = 0; i < PORT_WINDOW; i++)
+        hash = hash * PRIME + bytes[i];
+    for (size_t offset = 0;; offset++) {
+        uint64_t mixed = MixHash(hash);
+        if (mixed % PORT_SAMPLE_RATE == 0)
+            windows.push_back({ mixed, (uint32_t)offset });
+        if (offset + PORT_WINDOW >= bytes.size())
+            break;
+        hash = (hash - bytes[offset] * outFactor) * PRIME + bytes[offset + PORT_WINDOW];
+    }
+    std::sort(windows.begin(), windows.end(), [](const PortWindow& a, const PortWindow& b) {
+        return a.hash != b.hash ? a.hash < b.hash : a.offset < b.offset;
+    });
+    return windows;
+}
+
+PortIndex::PortIndex() = default;
+PortIndex::~PortIndex() = default;
+
+void PortIndex::Build(const PortText& oldText, const PortText& newText)
+{
+    auto oldWindows = HashWindows(oldText.bytes);
+    auto newWindows = HashWindows(newText.bytes);
+
+    // Merge the two sorted lists, keeping hashes that occur once on each
+    // side. Repeated code like padding and small thunks can't be placed.
+    built.clear();
+    size_t i = 0, j = 0;
+    while (i < oldWindows.size() && j < newWindows.size()) {
+        uint64_t hash = oldWindows[i].hash;
+        if (hash < newWindows[j].hash) {
+            i++;
+            continue;
+        }
+        if (hash > newWindows[j].hash) {
+            j++;
+            continue;
+        }
+        size_t oldEnd = i, newEnd = j;
+        while (oldEnd < oldWindows.size() && oldWindows[oldEnd].hash == hash)
+            oldEnd++;
+        while (newEnd < newWindows.size() && newWindows[newEnd].hash == hash)
+            newEnd++;
+        if (oldEnd - i == 1 && newEnd - j == 1)
+            built.push_back({ oldWindows[i].offset, newWindows[j].offset });
+        i = oldEnd;
+        j = newEnd;
+    }
+    std::sort(built.begin(), built.end(), [](const PortAnchor& a, const PortAnchor& b) {
+        return a.oldOffset < b.oldOffset;
+    });
+
+    memcpy(header.magic, PORT_INDEX_MAGIC, sizeof(header.magic));
+    header.version = PORT_INDEX_VERSION;
+    header.window = PORT_WINDOW;
+    header.oldTimeStamp = oldText.timeStamp;
+    header.newTimeStamp = newText.timeStamp;
+    header.oldTextSize = oldText.size;
+    header.newTextSize = newText.size;
+    header.count = (uint32_t)built.size();
+    header.oldTextAddress = oldText.address;
+    header.newTextAddress = newText.address;
+    file.reset();
+    anchors = built.data();
+    count = built.size();
+}
+
+bool PortIndex::Write(const char* fn) const
+{
+    FILE* out = OpenFileUtf8(fn, "wb");
+    if (!out)
+        return false;
+    bool written = fwrite(&header, sizeof(header), 1, out) == 1;
+    written &= fwrite(anchors, sizeof(PortAnchor), count, out) == count;
+    written &= fclose(out) == 0;
+    return written;
+}
+
+bool PortIndex::Open(const char* fn)
+{
+    anchors = nullptr;
+    count = 0;
+    built.clear();
+    file = std::make_unique<MappedFile>(fn);
+    if (!file->fileMapView || file->fileSize < sizeof(PortIndexHeader))
+        return false;
+    const uint8_t* data = (const uint8_t*)file->fileMapView;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, PORT_INDEX_MAGIC, sizeof(header.magic)) || header.version != PORT_INDEX_VERSION
+        || header.window != PORT_WINDOW)
+        return false;
+    if (sizeof(PortIndexHeader) + (uint64_t)header.count * sizeof(PortAnchor) != file->fileSize)
+        return false;
+    anchors = (const PortAnchor*)(data + sizeof(PortIndexHeader));
+    count = header.count;
+    return true;
+}
+
+bool PortIndex::Matches(const PortText& oldText, const PortText& newText) const
+{
+    return header.oldTimeStamp == oldText.timeStamp && header.oldTextSize == oldText.size && header.oldTextAddress == oldText.address
+        && header.newTimeStamp == newText.timeStamp && header.newTextSize == newText.size && header.newTextAddress == newText.address;
+}
+
+bool PortIndex::Port(uint64_t address, PortResult& resultOut) const
+{
+    if (address - header.oldTextAddress >= header.oldTextSize)
+        return false;
+    const uint32_t offset = (uint32_t)(address - header.oldTextAddress);
+    auto less = [](const PortAnchor& anchor, uint32_t value) {
+        return anchor.oldOffset < value;
+    };
+
+    std::vector<std::pair<int64_t, uint32_t>> votes; // shift, count
+    for (uint32_t radius = PORT_MIN_RADIUS; radius <= PORT_MAX_RADIUS; radius *= 4) {
+        votes.clear();
+        uint32_t total = 0;
+        const PortAnchor* it = std::lower_bound(anchors, anchors + count, offset > radius ? offset - radius : 0, less);
+        for (; it != anchors + count && it->oldOffset <= offset + radius; ++it) {
+            int64_t shift = (int64_t)it->newOffset - it->oldOffset;
+            auto vote = std::find_if(votes.begin(), votes.end(), [&](const std::pair<int64_t, uint32_t>& v) {
+                return v.first == shift;
+            });
+            if (vote == votes.end())
+                votes.push_back({ shift, 1 });
+            else
+                vote->second++;
+            total++;
+        }
+        if (!total)
+            continue;
+        auto best = std::max_element(votes.begin(), votes.end(), [](const std::pair<int64_t, uint32_t>& a, const std::pair<int64_t, uint32_t>& b) {
+            return a.second < b.second;
+        });
+        // Keep looking farther out while the few anchors found disagree
+        if (best->second < PORT_FULL_VOTES && best->second * 2 <= total && radius * 4 <= PORT_MAX_RADIUS)
+            continue;
+        int64_t newOffset = (int64_t)offset + best->first;
+        if (newOffset < 0 || newOffset >= header.newTextSize)
+            return false;
+        resultOut.address = header.newTextAddress + (uint64_t)newOffset;
+        resultOut.anchors = best->second;
+        resultOut.confidence = (double)best->second / total * std::min(1.0, (double)best->second / PORT_FULL_VOTES);
+        return true;
+    }
+    return false;
+}
+
+static void PrintPortAddrUsage()
+{
+    fprintf(stderr,
+        "usage: port-addr [-i index] <old exe> <new exe> <address>...\n"
+        "  Finds where code at the given addresses (hex) of the old build is in\n"
+        "  the new build. With -i the index of the two builds is saved to and\n"
+        "  loaded from the given file, so later queries skip building it.\n");
+}
+
+int port_addr_cli(int argc, char** argv)
+{
+    const char* indexFn = NULL;
+    std::vector<const char*> args;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-i") && i + 1 < argc)
+            indexFn = argv[++i];
+        else
+            args.push_back(argv[i]);
+    }
+    if (args.size() < 3) {
+        PrintPortAddrUsage();
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    PortText oldText, newText;
+    PortIndex index;
+    bool loaded = false;
+    // The headers are enough to tell if a saved index still applies
+    for (int pass = 0; pass < 2; pass++) {
+        bool headersOnly = pass == 0;
+        if (!ReadPortText(args[0], oldText, headersOnly)) {
+            fprintf(stderr, "Error: %s is not an exe with a .text section\n", args[0]);
+            return 1;
+        }
+        if (!ReadPortText(args[1], newText, headersOnly)) {
+            fprintf(stderr, "Error: %s is not an exe with a .text section\n", args[1]);
+            return 1;
+        }
+        if (headersOnly && indexFn && index.Open(indexFn) && index.Matches(oldText, newText)) {
+            loaded = true;
+            break;
+        }
+        if (headersOnly)
+            continue;
+        index.Build(oldText, newText);
+        if (indexFn && !index.Write(indexFn))
+            fprintf(stderr, "Warning: Couldn't write %s\n", indexFn);
+    }
+    fprintf(stderr, "%zu anchors %s in %.3fs\n", index.count, loaded ? "loaded" : "built",
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+    for (size_t i = 2; i < args.size(); i++) {
+        uint64_t address = strtoull(args[i], NULL, 16);
+        PortResult result;
+        if (index.Port(address, result))
+            printf("%08llx -> %08llx confidence %.2f (%u anchors)\n", (unsigned long long)address, (unsigned long long)result.address,
+                result.confidence, result.anchors);
+        else
+            printf("%08llx -> not found\n", (unsigned long long)address);
+    }
+    return 0;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+struct MappedFile;
+
+// Bytes per hashed window of code
+constexpr uint32_t PORT_WINDOW = 32;
+
+// .text of an exe with everything that moves between builds zeroed: rel8
+// and rel32 displacements of calls and jumps, and 32-bit values that point
+// into the image. x86 isn't decoded, opcode bytes are spotted wherever they
+// are, which is consistent between builds and that's all that matters.
+struct PortText {
+    uint64_t address; // virtual address of the first byte
+    uint32_t timeStamp;
+    uint32_t size;
+    std::vector<uint8_t> bytes;
+};
+
+// With `headersOnly` the bytes are left empty, which is enough to check
+// a saved index against the exe
+bool ReadPortText(const char* fn, PortText& textOut, bool headersOnly = false);
+
+// An old build's window offset and the new build's offset of the same
+// window, for windows that occur exactly once in both
+struct PortAnchor {
+    uint32_t oldOffset;
+    uint32_t newOffset;
+};
+
+// File layout, all little endian:
+//   PortIndexHeader
+//   PortAnchor[count], sorted by oldOffset
+struct PortIndexHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t window;
+    uint32_t oldTimeStamp;
+    uint32_t newTimeStamp;
+    uint32_t oldTextSize;
+    uint32_t newTextSize;
+    uint32_t count;
+    uint64_t oldTextAddress;
+    uint64_t newTextAddress;
+};
+
+struct PortResult {
+    uint64_t address; // in the new build
+    // Share of the nearby anchors that agree, 0 to 1, scaled down when only
+    // a few of them do
+    double confidence;
+    uint32_t anchors; // how many anchors agree
+};
+
+// Anchors between two builds. Windows are sampled by content, every 8th
+// hash or so, so the same code is sampled the same way in both builds.
+struct PortIndex {
+    PortIndexHeader header = {};
+    std::unique_ptr<MappedFile> file;
+    const PortAnchor* anchors = nullptr;
+    size_t count = 0;
+    std::vector<PortAnchor> built;
+
+    PortIndex();
+    ~PortIndex();
+
+    void Build(const PortText& oldText, const PortText& newText);
+    bool Write(const char* fn) const;
+    bool Open(const char* fn);
+    // Whether the index was made from these two builds
+    bool Matches(const PortText& oldText, const PortText& newText) const;
+    // Votes among the anchors around `address` on how far the code moved.
+    // False if there are none within reach.
+    bool Port(uint64_t address, PortResult& resultOut) const;
+};
@@ -0,0 +1,503 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <simd.h>
+#include <util.h>
+#include <parallel.h>
+#include <pe.h>
+#include "exe_sig.h"
+#include "aob_scan.h"
+
+// Rough rank of how often a byte shows up in 32-bit x86 code: padding,
+// mov/call/push opcodes, ModRM and SIB bytes of stack accesses. Anything not
+// listed counts as rare.
+static int AobByteCommonness(uint8_t byte)
+{
+    switch (byte) {
+    case 0x00:
+        return 10;
+    case 0xff:
+    case 0xcc:
+    case 0x8b:
+        return 9;
+    case 0x89:
+    case 0x0f:
+    case 0xe8:
+    case 0x83:
+    case 0x24:
+        return 7;
+    case 0x44:
+    case 0x45:
+    case 0x85:
+    case 0xc7:
+    case 0x90:
+        return 6;
+    case 0x01:
+    case 0x04:
+    case 0x08:
+    case 0x10:
+    case 0x74:
+    case 0x75:
+    case 0xc3:
+        return 5;
+    case 0x50:
+    case 0x51:
+    case 0x55:
+    case 0x56:
+    case 0x57:
+    case 0x5d:
+    case 0x5e:
+    case 0x5f:
+    case 0x6a:
+    case 0x68:
+    case 0xec:
+    case 0xe5:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+static void PickAobAnchors(AobPattern& pattern)
+{
+    size_t best = SIZE_MAX;
+    for (size_t i = 0; i < pattern.bytes.size(); i++) {
+        if (pattern.mask[i] && (best == SIZE_MAX || AobByteCommonness(pattern.bytes[i]) < AobByteCommonness(pattern.bytes[best])))
+            best = i;
+    }
+    // The second anchor is the rarest of the rest, the farther away the
+    // better, since neighbouring bytes tend to come in common pairs
+    size_t second = best;
+    for (size_t i = 0; i < pattern.bytes.size(); i++) {
+        if (!pattern.mask[i] || i == best)
+            continue;
+        if (second == best)
+            second = i;
+        int rank = AobByteCommonness(pattern.bytes[i]), secondRank = AobByteCommonness(pattern.bytes[second]);
+        size_t distance = i > best ? i - best : best - i;
+        size_t secondDistance = second > best ? second - best : best - second;
+        if (rank < secondRank || (rank == secondRank && distance > secondDistance))
+            second = i;
+    }
+    pattern.anchor[0] = best;
+    pattern.anchor[1] = second;
+}
+
+bool ParseAobPattern(const char* text, AobPattern& patternOut)
+{
+    patternOut.bytes.clear();
+    patternOut.mask.clear();
+    bool anyFixed = false;
+    for (const char* p = text; *p;) {
+        if (*p == ' ' || *p == '\t') {
+            p++;
+            continue;
+        }
+        if (p[0] == '?') {
+            p += p[1] == '?' ? 2 : 1;
+            patternOut.bytes.push_back(0);
+            patternOut.mask.push_back(0);
+            continue;
+        }
+        int hi = HexDigit(p[0]), lo = hi >= 0 ? HexDigit(p[1]) : -1;
+        if (lo < 0)
+            return false;
+        p += 2;
+        patternOut.bytes.push_back((uint8_t)(hi << 4 | lo));
+        patternOut.mask.push_back(0xff);
+        anyFixed = true;
+    }
+    if (!anyFixed)
+        return false;
+    PickAobAnchors(patternOut);
+    return true;
+}
+
+bool ReadAobPatternFile(const char* fn, std::vector<AobPattern>& patternsOut)
+{
+    patternsOut.clear();
+    MappedFile file(fn);
+    if (!file.fileMapView) {
+        fprintf(stderr, "Error: Couldn't open %s\n", fn);
+        return false;
+    }
+    const char* data = (const char*)file.fileMapView;
+    std::string line;
+    unsigned int lineNumber = 0;
+    for (size_t pos = 0; pos < file.fileSize;) {
+        const char* end = (const char*)memchr(data + pos, '\n', file.fileSize - pos);
+        size_t length = end ? (size_t)(end - (data + pos)) : file.fileSize - pos;
+        line.assign(data + pos, length);
+        pos += length + 1;
+        lineNumber++;
+
+        line.erase(std::min(line.find('#'), line.size()));
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' ' || line.back() == '\t'))
+            line.pop_back();
+        if (line.find_first_not_of(" \t") == std::string::npos)
+            continue;
+
+        AobPattern pattern;
+        size_t colon = line.find(':');
+        if (colon != std::string::npos) {
+            size_t nameBegin = line.find_first_not_of(" \t");
+            size_t nameEnd = line.find_last_not_of(" \t", colon - 1);
+            if (nameBegin < colon)
+                pattern.name = line.substr(nameBegin, nameEnd + 1 - nameBegin);
+        }
+        // The name becomes a field of the generated header
+        bool identifier = !pattern.name.empty() && !isdigit((unsigned char)pattern.name[0]);
+        for (char c : pattern.name)
+            identifier &= isalnum((unsigned char)c) || c == '_';
+        if (!identifier || !ParseAobPattern(line.c_str() + colon + 1, pattern)) {
+            fprintf(stderr, "Error: %s:%u: Expected \"name: pattern\"\n", fn, lineNumber);
+            return false;
+        }
+        patternsOut.push_back(std::move(pattern));
+    }
+    return true;
+}
+
+static bool AobMatches(const uint8_t* data, const AobPattern& pattern)
+{
+    for (size_t i = 0; i < pattern.bytes.size(); i++) {
+        if ((data[i] & pattern.mask[i]) != pattern.bytes[i])
+            return false;
+    }
+    return true;
+}
+
+static void FindAobPatternScalar(const uint8_t* data, size_t begin, size_t count, const AobPattern& pattern, uint64_t base, std::vector<uint64_t>& matchesOut)
+{
+    const size_t first = pattern.anchor[0];
+    const uint8_t firstByte = pattern.bytes[first];
+    for (size_t pos = begin; pos < count;) {
+        auto hit = (const uint8_t*)memchr(data + pos + first, firstByte, count - pos);
+        if (!hit)
+            break;
+        pos = (size_t)(hit - data) - first;
+        if (AobMatches(data + pos, pattern))
+            matchesOut.push_back(base + pos);
+        pos++;
+    }
+}
+
+#ifdef SIMD_X86
+// Both anchors are compared 32 positions at a time, only the positions where
+// both hit get the full masked compare. Returns how far it got.
+SIMD_TARGET_AVX2
+static size_t FindAobPatternAvx2(const uint8_t* data, size_t count, const AobPattern& pattern, uint64_t base, std::vector<uint64_t>& matchesOut)
+{
+    const __m256i first = _mm256_set1_epi8((char)pattern.bytes[pattern.anchor[0]]);
+    const __m256i second = _mm256_set1_epi8((char)pattern.bytes[pattern.anchor[1]]);
+    size_t pos = 0;
+    for (; pos + 32 <= count; pos += 32) {
+        __m256i blockFirst = _mm256_loadu_si256((const __m256i*)(data + pos + pattern.anchor[0]));
+        __m256i blockSecond = _mm256_loadu_si256((const __m256i*)(data + pos + pattern.anchor[1]));
+        __m256i match = _mm256_and_si256(_mm256_cmpeq_epi8(blockFirst, first), _mm256_cmpeq_epi8(blockSecond, second));
+        for (uint32_t mask = (uint32_t)_mm256_movemask_epi8(match); mask; mask &= mask - 1) {
+            size_t at = pos + SimdLowestBit(mask);
+            if (AobMatches(data + at, pattern))
+                matchesOut.push_back(base + at);
+        }
+    }
+    return pos;
+}
+#endif
+
+void FindAobPattern(const uint8_t* data, size_t size, const AobPattern& pattern, uint64_t base, std::vector<uint64_t>& matchesOut)
+{
+    if (pattern.bytes.empty() || size < pattern.bytes.size())
+        return;
+    // Number of positions the pattern fits at
+    size_t count = size - pattern.bytes.size() + 1;
+    size_t begin = 0;
+#ifdef SIMD_X86
+    if (SimdHasAvx2())
+        begin = FindAobPatternAvx2(data, count, pattern, base, matchesOut);
+#endif
+    FindAobPatternScalar(data, begin, count, pattern, base, matchesOut);
+}
+
+AobMatcher::AobMatcher(const std::vector<AobPattern>& patterns)
+    : patterns(patterns)
+    , pairBits(65536 / 64)
+    , pairStart(65536 + 1)
+    , byteStart(256 + 1)
+{
+    // Bucket keys, counted first and then placed, so each bucket is a
+    // contiguous run of entries
+    std::vector<uint32_t> keys(patterns.size());
+    std::vector<char> isPair(patterns.size());
+    std::vector<uint32_t> offsets(patterns.size());
+    for (uint32_t i = 0; i < patterns.size(); i++) {
+        const AobPattern& pattern = patterns[i];
+        int best = INT32_MAX;
+        for (size_t k = 0; k + 1 < pattern.bytes.size(); k++) {
+            if (!pattern.mask[k] || !pattern.mask[k + 1])
+                continue;
+            int rank = AobByteCommonness(pattern.bytes[k]) + AobByteCommonness(pattern.bytes[k + 1]);
+            if (rank < best) {
+                best = rank;
+                offsets[i] = (uint32_t)k;
+            }
+        }
+        isPair[i] = best != INT32_MAX;
+        if (isPair[i]) {
+            keys[i] = pattern.bytes[offsets[i]] | pattern.bytes[offsets[i] + 1] << 8;
+            pairBits[keys[i] / 64] |= 1ull << (keys[i] % 64);
+            pairStart[keys[i] + 1]++;
+        } else {
+            offsets[i] = (uint32_t)pattern.anchor[0];
+            keys[i] = pattern.bytes[offsets[i]];
+            byteStart[keys[i] + 1]++;
+        }
+    }
+    for (size_t k = 1; k < pairStart.size(); k++)
+        pairStart[k] += pairStart[k - 1];
+    for (size_t k = 1; k < byteStart.size(); k++)
+        byteStart[k] += byteStart[k - 1];
+    pairEntries.resize(pairStart.back());
+    byteEntries.resize(byteStart.back());
+    std::vector<uint32_t> pairFill(pairStart.begin(), pairStart.end() - 1);
+    std::vector<uint32_t> byteFill(byteStart.begin(), byteStart.end() - 1);
+    for (uint32_t i = 0; i < patterns.size(); i++) {
+        if (isPair[i])
+            pairEntries[pairFill[keys[i]]++] = { i, offsets[i] };
+        else
+            byteEntries[byteFill[keys[i]]++] = { i, offsets[i] };
+    }
+}
+
+void AobMatcher::Scan(const uint8_t* data, size_t size, uint64_t base, std::vector<std::vector<uint64_t>>& matchesOut) const
+{
+    matchesOut.assign(patterns.size(), {});
+    // A lone pattern is faster with its own two anchor filter
+    if (patterns.size() == 1) {
+        FindAobPattern(data, size, patterns[0], base, matchesOut[0]);
+        return;
+    }
+
+    auto check = [&](const Entry& entry, size_t pos) {
+        const AobPattern& pattern = patterns[entry.pattern];
+        if (pos < entry.offset)
+            return;
+        size_t start = pos - entry.offset;
+        if (pattern.bytes.size() <= size - start && AobMatches(data + start, pattern))
+            matchesOut[entry.pattern].push_back(base + start);
+    };
+    const bool anyBytes = !byteEntries.empty();
+    for (size_t pos = 0; pos < size; pos++) {
+        if (pos + 1 < size) {
+            uint32_t key = data[pos] | data[pos + 1] << 8;
+            if (pairBits[key / 64] & (1ull << (key % 64))) {
+                for (uint32_t e = pairStart[key]; e < pairStart[key + 1]; e++)
+                    check(pairEntries[e], pos);
+            }
+        }
+        if (anyBytes) {
+            for (uint32_t e = byteStart[data[pos]]; e < byteStart[data[pos] + 1]; e++)
+                check(byteEntries[e], pos);
+        }
+    }
+}
+
+bool AobScanFile(const char* fn, const AobMatcher& matcher, AobScanResult& resultOut)
+{
+    resultOut.path = fn;
+    resultOut.matches.assign(matcher.PatternCount(), {});
+    MappedFile file(fn);
+    if (!file.fileMapView)
+        return false;
+    PeView exe(file.fileMapView, file.fileSize);
+    if (!exe.IsValid())
+        return false;
+    resultOut.timeStamp = exe.ntHeaders->FileHeader.TimeDateStamp;
+    const PeSectionHeader* text = exe.FindSection(".text");
+    const uint8_t* textData = text ? exe.SectionData(*text) : nullptr;
+    if (!textData)
+        return false;
+    uint64_t textAddress = (uint64_t)exe.ntHeaders->OptionalHeader.ImageBase + text->VirtualAddress;
+    matcher.Scan(textData, PeView::SectionDataSize(*text), textAddress, resultOut.matches);
+    return true;
+}
+
+void FormatAobHeader(std::string& output, const std::vector<AobPattern>& patterns, const std::vector<AobScanResult>& results)
+{
+    char line[512];
+    output += "// THIS FILE IS AUTOGENERATED\n"
+              "// Use the thprac devtools aob-scan command to regenerate this file\n"
+              "// https://github.com/touhouworldcup/thprac_utils/\n\n"
+              "#pragma once\n"
+              "#include <cstdint>\n\n"
+              "namespace THPrac {\n\n"
+              "struct aob_addresses_t {\n"
+              "    uint32_t timeStamp;\n";
+    for (auto& pattern : patterns) {
+        snprintf(line, sizeof(line), "    uint32_t %s;\n", pattern.name.c_str());
+        output += line;
+    }
+    output += "};\n\n"
+              "static const aob_addresses_t aob_addresses[] = {\n";
+    for (auto& result : results) {
+        snprintf(line, sizeof(line), "    // %s\n    { 0x%08x,\n", std::filesystem::u8path(result.path).filename().u8string().c_str(), result.timeStamp);
+        output += line;
+        for (size_t i = 0; i < patterns.size(); i++) {
+            auto& matches = result.matches[i];
+            const char* separator = i + 1 < patterns.size() ? "," : "";
+            if (matches.empty())
+                snprintf(line, sizeof(line), "        0x00000000%s // %s: not found\n", separator, patterns[i].name.c_str());
+            else if (matches.size() > 1)
+                snprintf(line, sizeof(line), "        0x%08x%s // %s: %zu matches\n", (uint32_t)matches[0], separator, patterns[i].name.c_str(), matches.size());
+            else
+                snprintf(line, sizeof(line), "        0x%08x%s\n", (uint32_t)matches[0], separator);
+            output += line;
+        }
+        output += "    },\n";
+    }
+    output += "};\n\n"
+              "}\n";
+}
+
+static void AppendCsvField(std::string& output, const std::string& field)
+{
+    if (field.find_first_of(",\"\n") == std::string::npos) {
+        output += field;
+        return;
+    }
+    output += '"';
+    for (char c : field) {
+        if (c == '"')
+            output += '"';
+        output += c;
+    }
+    output += '"';
+}
+
+void FormatAobMatrix(std::string& output, const std::vector<AobPattern>& patterns, const std::vector<AobScanResult>& results)
+{
+    char address[32];
+    output += "pattern";
+    for (auto& result : results) {
+        output += ",";
+        AppendCsvField(output, result.path);
+    }
+    output += "\n";
+    for (size_t i = 0; i < patterns.size(); i++) {
+        output += patterns[i].name;
+        for (auto& result : results) {
+            output += ",";
+            for (size_t m = 0; m < result.matches[i].size(); m++) {
+                snprintf(address, sizeof(address), m ? " 0x%08llx" : "0x%08llx", (unsigned long long)result.matches[i][m]);
+                output += address;
+            }
+        }
+        output += "\n";
+    }
+}
+
+static void PrintAobScanUsage()
+{
+    fprintf(stderr,
+        "usage: aob-scan [-j threads] [-o output] [--csv file] <patterns> <file|dir>...\n"
+        "  Searches the .text section of every exe for the patterns, given one\n"
+        "  per line as \"name: 8b 0d ?? ?? ?? ?? 85 c9\". With -o the addresses\n"
+        "  are written as a header with one entry per exe, --csv writes them as a\n"
+        "  pattern by exe table.\n");
+}
+
+int aob_scan_cli(int argc, char** argv)
+{
+    unsigned int numThreads = 0;
+    const char* outputFn = NULL;
+    const char* csvFn = NULL;
+    std::vector<std::string> inputs;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-j") && i + 1 < argc)
+            numThreads = (unsigned int)strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+            outputFn = argv[++i];
+        else if (!strcmp(argv[i], "--csv") && i + 1 < argc)
+            csvFn = argv[++i];
+        else
+            inputs.push_back(argv[i]);
+    }
+    if (inputs.size() < 2) {
+        PrintAobScanUsage();
+        return 1;
+    }
+
+    std::vector<AobPattern> patterns;
+    if (!ReadAobPatternFile(inputs[0].c_str(), patterns))
+        return 1;
+    inputs.erase(inputs.begin());
+    auto files = FindExeFiles(inputs, false);
+
+    // One matcher for all patterns, one pass over each exe, exes in parallel
+    auto start = std::chrono::steady_clock::now();
+    AobMatcher matcher(patterns);
+    std::vector<AobScanResult> results(files.size());
+    std::vector<char> scanned(files.size());
+    std::atomic<size_t> nextFile { 0 };
+    RunThreads(ThreadCount(numThreads, files.size()), [&](unsigned int) {
+        for (size_t i; (i = nextFile.fetch_add(1)) < files.size();)
+            scanned[i] = AobScanFile(files[i].c_str(), matcher, results[i]);
+    });
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<AobScanResult> found;
+    std::string output;
+    char line[64];
+    for (size_t i = 0; i < files.size(); i++) {
+        if (!scanned[i]) {
+            fprintf(stderr, "Warning: %s is not an exe with a .text section\n", files[i].c_str());
+            continue;
+        }
+        size_t missing = 0, ambiguous = 0;
+        for (size_t p = 0; p < patterns.size(); p++) {
+            auto& matches = results[i].matches[p];
+            missing += matches.empty();
+            ambiguous += matches.size() > 1;
+            if (outputFn || csvFn)
+                continue;
+            output += files[i] + " " + patterns[p].name;
+            for (uint64_t match : matches) {
+                snprintf(line, sizeof(line), " %08llx", (unsigned long long)match);
+                output += line;
+            }
+            output += "\n";
+        }
+        if (missing || ambiguous)
+            fprintf(stderr, "Warning: %zu patterns not found and %zu found more than once in %s\n", missing, ambiguous, files[i].c_str());
+        found.push_back(std::move(results[i]));
+    }
+    fprintf(stderr, "Scanned %zu exes for %zu patterns in %.3fs\n", found.size(), patterns.size(), elapsed);
+
+    auto writeOutput = [](const char* fn, const std::string& text) {
+        FILE* out = OpenFileUtf8(fn, "wb");
+        bool written = out && fwrite(text.data(), 1, text.size(), out) == text.size();
+        if (out)
+            written &= fclose(out) == 0;
+        if (!written)
+            fprintf(stderr, "Error: Couldn't write %s\n", fn);
+        return written;
+    };
+    if (outputFn) {
+        std::string header;
+        FormatAobHeader(header, patterns, found);
+        if (!writeOutput(outputFn, header))
+            return 1;
+    }
+    if (csvFn) {
+        std::string matrix;
+        FormatAobMatrix(matrix, patterns, found);
+        if (!writeOutput(csvFn, matrix))
+            return 1;
+    }
+    fwrite(output.data(), 1, output.size(), stdout);
+    return 0;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Array of bytes pattern like "8b 0d ?? ?? ?? ?? 85 c9", where ?? matches
+// any byte
+struct AobPattern {
+    std::string name;
+    std::vector<uint8_t> bytes;
+    std::vector<uint8_t> mask; // 0xff for a fixed byte, 0 for a wildcard
+    // The two fixed bytes candidates are filtered on before comparing the
+    // whole pattern. Picked to be rare in x86 code and far apart.
+    size_t anchor[2];
+};
+
+// Needs at least one fixed byte
+bool ParseAobPattern(const char* text, AobPattern& patternOut);
+// One "name: pattern" per line, # starts a comment
+bool ReadAobPatternFile(const char* fn, std::vector<AobPattern>& patternsOut);
+
+// Offsets of `pattern` in `data`, with `base` added
+void FindAobPattern(const uint8_t* data, size_t size, const AobPattern& pattern, uint64_t base, std::vector<uint64_t>& matchesOut);
+
+// Finds any number of patterns in one pass over the data. Every pattern is
+// filed under its rarest pair of adjacent fixed bytes, and a bitmap of the
+// used pairs rejects most positions with a single lookup. Patterns without
+// two adjacent fixed bytes fall back to a bucket per single byte.
+struct AobMatcher {
+    // Keeps its own copy of the patterns
+    AobMatcher(const std::vector<AobPattern>& patterns);
+    // matchesOut[i] gets the offsets of patterns[i], with `base` added
+    void Scan(const uint8_t* data, size_t size, uint64_t base, std::vector<std::vector<uint64_t>>& matchesOut) const;
+    size_t PatternCount() const { return patterns.size(); }
+
+private:
+    std::vector<AobPattern> patterns;
+    struct Entry {
+        uint32_t pattern;
+        uint32_t offset; // of the anchor in the pattern
+    };
+    std::vector<uint64_t> pairBits;
+    // Entries of bucket k are [pairStart[k], pairStart[k + 1])
+    std::vector<uint32_t> pairStart;
+    std::vector<Entry> pairEntries;
+    std::vector<uint32_t> byteStart;
+    std::vector<Entry> byteEntries;
+};
+
+struct AobScanResult {
+    std::string path;
+    uint32_t timeStamp;
+    // Virtual addresses of the matches in .text, one list per pattern
+    std::vector<std::vector<uint64_t>> matches;
+};
+
+// Maps the exe and scans its .text section for every pattern of `matcher`
+bool AobScanFile(const char* fn, const AobMatcher& matcher, AobScanResult& resultOut);
+
+// Appends a header with one initializer of addresses per scanned exe.
+// Patterns that weren't found are 0, ambiguous ones take the first match.
+void FormatAobHeader(std::string& output, const std::vector<AobPattern>& patterns, const std::vector<AobScanResult>& results);
+// Appends a CSV table with a row per pattern and a column per exe. Cells
+// list every match, space separated, and are empty if there is none.
+void FormatAobMatrix(std::string& output, const std::vector<AobPattern>& patterns, const std::vector<AobScanResult>& results);
@@ -0,0 +1,370 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "metrohash128.h"
+#include "metrohash128mb.h"
+#include "parallel.h"
+#include "loc_json.h"
+#include "text_writer.h"
+
+// Throughput benchmarks for the batch paths, run as "thprac_devtools bench"
+
+using bench_clock = std::chrono::steady_clock;
+
+static double SecondsSince(bench_clock::time_point start)
+{
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+static void FillRandom(std::vector<uint8_t>& data, uint64_t seed)
+{
+    uint64_t x = seed | 1;
+    for (auto& b : data) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        b = (uint8_t)x;
+    }
+}
+
+// Scalar MetroHash128::Hash against the multi-buffer kernel at every lane
+// width this CPU has, over `count` buffers of `size` bytes
+static int bench_hash(size_t size, size_t count, unsigned int rounds)
+{
+    std::vector<uint8_t> data(size * count);
+    FillRandom(data, 0x7468707261632121);
+
+    std::vector<const uint8_t*> buffers;
+    std::vector<uint64_t> lengths;
+    std::vector<uint8_t> expected(count * 16), actual(count * 16);
+    std::vector<uint8_t*> hashes;
+    for (size_t i = 0; i < count; i++) {
+        buffers.push_back(&data[i * size]);
+        lengths.push_back(size);
+        hashes.push_back(&actual[i * 16]);
+    }
+
+    double megabytes = (double)data.size() * rounds / (1024 * 1024);
+    printf("Hashing %zu buffers of %zu bytes, %u rounds\n", count, size, rounds);
+
+    auto start = bench_clock::now();
+    for (unsigned int r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < count; i++)
+            MetroHash128::Hash(buffers[i], lengths[i], &expected[i * 16]);
+    }
+    double scalar = SecondsSince(start);
+    printf("  scalar:    %8.1f MiB/s\n", megabytes / scalar);
+
+    const unsigned int widths[] = { 4, 8 };
+    for (auto lanes : widths) {
+        if (lanes > MetroHash128MB::Lanes()) {
+            printf("  %u lanes:   not supported by this CPU\n", lanes);
+            continue;
+        }
+        start = bench_clock::now();
+        for (unsigned int r = 0; r < rounds; r++)
+            MetroHash128MB::HashLanes(lanes, buffers.data(), lengths.data(), hashes.data(), count);
+        double seconds = SecondsSince(start);
+        bool same = !memcmp(actual.data(), expected.data(), expected.size());
+        printf("  %u lanes:   %8.1f MiB/s (%.2fx)%s\n", lanes, megabytes / seconds, scalar / seconds, same ? "" : " MISMATCH");
+        if (!same)
+            return 1;
+    }
+    return 0;
+}
+
+// A thprac_games_def.json shaped like the real one, with `games` games of
+// `sections` sections each. Strings contain quotes, newlines and
+// backslashes now and then, so the escaping is exercised too.
+static std::string MakeGamesJson(size_t games, size_t sections, uint64_t seed)
+{
+    uint64_t x = seed | 1;
+    auto next = [&]() {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        return x;
+    };
+    auto word = [&](std::string& out) {
+        size_t length = 3 + next() % 8;
+        for (size_t i = 0; i < length; i++)
+            out += (char)('a' + next() % 26);
+    };
+    auto locString = [&](std::string& out) {
+        out += "[\"\xe4\xb8\xad\xe6\x96\x87";
+        word(out);
+        if (next() % 10 == 0)
+            out += "\\\"\xe5\xbc\x95\\\"";
+        out += "\", \"";
+        word(out);
+        out += ' ';
+        word(out);
+        if (next() % 10 == 0)
+            out += "\\n";
+        if (next() % 20 == 0)
+            out += "\\\\x";
+        out += "\", \"\xe6\x97\xa5\xe6\x9c\xac";
+        word(out);
+        out += "\"]";
+    };
+
+    std::string json = "{\n";
+    std::vector<std::string> glossary;
+    char name[128];
+    for (size_t g = 0; g < games; g++) {
+        snprintf(name, sizeof(name), "%s \"game%zu\": {\n  \"namespace\": \"TH%02zu\",\n  \"glossary\": {", g ? ",\n" : "", g, g);
+        json += name;
+        size_t entries = 5 + next() % 36;
+        for (size_t i = 0; i < entries; i++) {
+            std::string key = "TH" + std::to_string(g) + "_";
+            word(key);
+            glossary.push_back(key);
+            json += i ? ",\n   \"" : "\n   \"";
+            json += key + "\": ";
+            locString(json);
+        }
+        json += "\n  },\n  \"sections\": {";
+        for (size_t i = 0; i < sections; i++) {
+            snprintf(name, sizeof(name), "%s\n   \"TH%02zu_ST%zu_", i ? "," : "", g, i);
+            json += name;
+            word(json);
+            json += next() % 2 ? "\": {\"!X\": " : "\": {\"!EN\": ";
+            if (next() % 10 < 7)
+                locString(json);
+            else
+                json += "\"" + glossary[next() % glossary.size()] + "\"";
+            if (next() % 10 < 3) {
+                json += ", \"!HL\": ";
+                locString(json);
+            }
+            snprintf(name, sizeof(name), ", \"bgm\": %d, \"appearance\": [%d, %d, %d]",
+                (int)(next() % 21), (int)(1 + next() % 6), (int)(1 + next() % 8), (int)(1 + next() % 10));
+            json += name;
+            if (next() % 10 < 4)
+                json += ", \"spell\": " + std::to_string(1 + next() % 200);
+            json += "}";
+        }
+        json += "\n  },\n  \"groups\": {";
+        size_t groups = 1 + next() % 5;
+        for (size_t i = 0; i < groups; i++) {
+            snprintf(name, sizeof(name), "%s\n   \"th%02zu_group_%zu\": [", i ? "," : "", g, i);
+            json += name;
+            size_t size = 1 + next() % 10;
+            for (size_t j = 0; j < size; j++)
+                json += (j ? ", \"" : "\"") + glossary[next() % glossary.size()] + "\"";
+            json += "]";
+        }
+        json += "\n  }\n }";
+    }
+    json += "\n}\n";
+    return json;
+}
+
+// Roots that aren't objects have to be reported as errors, copying and in
+// situ. A string root once read an empty frame stack.
+static bool LocJsonRejectsScalarRoots()
+{
+    static const char* const roots[] = { "\"abc\"", "\"\"", "\"a\\u0000b\"", "[1,2]", "[\"abc\"]", "42", "null" };
+    std::string header, source, warnings;
+    for (const char* root : roots) {
+        std::string insitu = root;
+        if (generate_loc_json(root, strlen(root), header, source, warnings)
+            || generate_loc_json(root, strlen(root), header, source, warnings, nullptr, 1, &insitu[0]))
+            return false;
+    }
+    return true;
+}
+
+// Generates thprac_locale_def.h and .cpp from a synthetic games file, or
+// from `fn` if given, and reports the time spent in each step. Then again
+// on `numThreads` threads, and parsing a copy of the file in situ, which
+// both have to give the same output.
+static int bench_codegen(const char* fn, size_t games, size_t sections, unsigned int rounds, unsigned int numThreads)
+{
+    if (!LocJsonRejectsScalarRoots()) {
+        fprintf(stderr, "Error: loc_json accepted a JSON root that isn't an object\n");
+        return 1;
+    }
+
+    std::string json;
+    if (fn) {
+        FILE* in = fopen(fn, "rb");
+        if (!in) {
+            fprintf(stderr, "Error: Couldn't open %s\n", fn);
+            return 1;
+        }
+        char buffer[65536];
+        for (size_t n; (n = fread(buffer, 1, sizeof(buffer), in));)
+            json.append(buffer, n);
+        fclose(in);
+    } else {
+        json = MakeGamesJson(games, sections, 0x7468707261632121);
+    }
+
+    std::string header, source, warnings, scratch;
+    auto run = [&](unsigned int threads, bool insitu, loc_json_times_t& best) {
+        for (unsigned int r = 0; r < rounds; r++) {
+            loc_json_times_t times;
+            scratch = json;
+            if (!generate_loc_json(json.data(), json.size(), header, source, warnings, &times, threads,
+                    insitu ? &scratch[0] : nullptr)) {
+                fprintf(stderr, "%s", warnings.c_str());
+                return false;
+            }
+            // Best of the rounds, the others mostly measure page faults
+            if (!r || times.build + times.header + times.source < best.build + best.header + best.source)
+                best = times;
+        }
+        return true;
+    };
+    loc_json_times_t best = {};
+    if (!run(1, false, best))
+        return 1;
+    std::string sequentialHeader = header, sequentialSource = source, sequentialWarnings = warnings;
+
+    double outputMiB = (double)(header.size() + source.size()) / (1024 * 1024);
+    printf("Generating from %.1f MiB of JSON, %.1f MiB of output, best of %u rounds\n",
+        json.size() / (1024.0 * 1024), outputMiB, rounds);
+    printf("  parse:     %8.1f ms\n", best.parse * 1000);
+    printf("  build:     %8.1f ms\n", best.build * 1000);
+    printf("  header:    %8.1f ms\n", best.header * 1000);
+    printf("  source:    %8.1f ms\n", best.source * 1000);
+    printf("  emitters:  %8.1f MiB/s\n", outputMiB / (best.header + best.source));
+
+    double sequential = best.build + best.header + best.source;
+    double copyingParse = best.parse;
+    if (!run(numThreads, false, best))
+        return 1;
+    double parallel = best.build + best.header + best.source;
+    bool same = header == sequentialHeader && source == sequentialSource && warnings == sequentialWarnings;
+    printf("  sequential build + generate: %8.1f ms\n", sequential * 1000);
+    printf("  %u threads build + generate: %8.1f ms (%.2fx)%s\n", ThreadCount(numThreads, SIZE_MAX), parallel * 1000,
+        sequential / parallel, same ? "" : " MISMATCH");
+
+    if (!run(1, true, best))
+        return 1;
+    bool sameInsitu = header == sequentialHeader && source == sequentialSource && warnings == sequentialWarnings;
+    printf("  in situ parse:  %8.1f ms (%.2fx)%s\n", best.parse * 1000, copyingParse / best.parse,
+        sameInsitu ? "" : " MISMATCH");
+    return same && sameInsitu ? 0 : 1;
+}
+
+// EscapeCString against the insert based escaper it replaced, on `count`
+// strings of `size` bytes where one byte in `rarity` needs escaping
+static int bench_escape(size_t size, size_t count, unsigned int rarity, unsigned int rounds)
+{
+    static const char special[] = { '"', '\\', '\n' };
+    std::vector<uint8_t> random(size * count);
+    FillRandom(random, 0x7468707261632121);
+    std::vector<std::string> texts(count);
+    for (size_t i = 0; i < count; i++) {
+        texts[i].resize(size);
+        for (size_t j = 0; j < size; j++) {
+            uint8_t r = random[i * size + j];
+            texts[i][j] = rarity && r % rarity == 0 ? special[r % 3] : (char)('a' + r % 26);
+        }
+    }
+
+    double megabytes = (double)size * count * rounds / (1024 * 1024);
+    printf("Escaping %zu strings of %zu bytes, ", count, size);
+    if (rarity)
+        printf("1 in %u special, %u rounds\n", rarity, rounds);
+    else
+        printf("none special, %u rounds\n", rounds);
+
+    size_t expectedSize = 0;
+    auto start = bench_clock::now();
+    for (unsigned int r = 0; r < rounds; r++) {
+        for (auto& text : texts)
+            expectedSize += EscapeCStringReference(text).size();
+    }
+    double reference = SecondsSince(start);
+    printf("  insert:    %8.1f MiB/s\n", megabytes / reference);
+
+    size_t actualSize = 0;
+    TextWriter out;
+    start = bench_clock::now();
+    for (unsigned int r = 0; r < rounds; r++) {
+        for (auto& text : texts) {
+            out.Clear();
+            out.Escaped(text);
+            actualSize += out.Size();
+        }
+    }
+    double seconds = SecondsSince(start);
+    bool same = actualSize == expectedSize;
+    printf("  scan:      %8.1f MiB/s (%.2fx)%s\n", megabytes / seconds, reference / seconds, same ? "" : " MISMATCH");
+    return same ? 0 : 1;
+}
+
+static void PrintBenchUsage()
+{
+    fprintf(stderr,
+        "usage: bench hash [-s buffer_size] [-n buffers] [-r rounds]\n"
+        "       bench codegen [-j threads] [-g games] [-n sections] [-r rounds] [-i games_def.json]\n"
+        "       bench escape [-s string_size] [-n strings] [-e rarity] [-r rounds]\n"
+        "  hash compares the scalar and multi-buffer MetroHash128 throughput.\n"
+        "  codegen times each step of the loc_json generator, then all of it on\n"
+        "  several threads.\n"
+        "  escape compares the string escapers, 1 in rarity bytes needs escaping.\n");
+}
+
+int bench_cli(int argc, char** argv)
+{
+    if (argc < 2) {
+        PrintBenchUsage();
+        return 1;
+    }
+
+    bool codegen = !strcmp(argv[1], "codegen");
+    bool escape = !strcmp(argv[1], "escape");
+    size_t size = escape ? 4096 : 1 << 20;
+    size_t count = codegen ? 2000 : escape ? 1024 : 64;
+    unsigned int rarity = 16;
+    unsigned int numThreads = 0;
+    size_t games = 60;
+    const char* input = NULL;
+    unsigned int rounds = codegen ? 5 : 8;
+    for (int i = 2; i < argc; i++) {
+        if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            size = strtoull(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            count = strtoull(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+            rounds = (unsigned int)strtoul(argv[++i], NULL, 0);
+        } else if (codegen && !strcmp(argv[i], "-g") && i + 1 < argc) {
+            games = strtoull(argv[++i], NULL, 0);
+        } else if (codegen && !strcmp(argv[i], "-j") && i + 1 < argc) {
+            numThreads = (unsigned int)strtoul(argv[++i], NULL, 0);
+        } else if (codegen && !strcmp(argv[i], "-i") && i + 1 < argc) {
+            input = argv[++i];
+        } else if (escape && !strcmp(argv[i], "-e") && i + 1 < argc) {
+            rarity = (unsigned int)strtoul(argv[++i], NULL, 0);
+        } else {
+            PrintBenchUsage();
+            return 1;
+        }
+    }
+
+    if (!strcmp(argv[1], "hash")) {
+        if (!MetroHash128MB::ImplementationVerified()) {
+            fprintf(stderr, "Error: Multi-buffer MetroHash128 doesn't match the scalar one\n");
+            return 1;
+        }
+        return bench_hash(size, count, rounds);
+    }
+    if (escape) {
+        if (!EscapeCStringVerified()) {
+            fprintf(stderr, "Error: EscapeCString doesn't match the reference escaper\n");
+            return 1;
+        }
+        return bench_escape(size, count, rarity, rounds);
+    }
+    if (codegen && rounds)
+        return bench_codegen(input, games, count, rounds, numThreads);
+    PrintBenchUsage();
+    return 1;
+}
@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <string.h>
+
+// Headless entry point. On Windows wWinMain hands over here when the program
+// is started with arguments, elsewhere this is the whole program.
+
+extern int exe_sig_cli(int argc, char** argv);
+extern int identify_cli(int argc, char** argv);
+extern int image_sig_cli(int argc, char** argv);
+extern int mem_scan_cli(int argc, char** argv);
+extern int ptr_scan_cli(int argc, char** argv);
+extern int aob_scan_cli(int argc, char** argv);
+extern int port_addr_cli(int argc, char** argv);
+extern int loc_json_cli(int argc, char** argv);
+extern int bench_cli(int argc, char** argv);
+
+static const struct {
+    const char* name;
+    int (*run)(int argc, char** argv);
+    const char* description;
+} cli_commands[] = {
+    { "exe-sig", exe_sig_cli, "Generate exe signatures for every executable in a directory tree" },
+    { "identify", identify_cli, "Look executables up in a signature database" },
+    { "image-sig", image_sig_cli, "Sign a running game from its memory image" },
+    { "mem-scan", mem_scan_cli, "Search the memory of a running game for a value" },
+    { "ptr-scan", ptr_scan_cli, "Find pointer chains from the game's exe to an address" },
+    { "aob-scan", aob_scan_cli, "Find byte patterns in the code of game exes" },
+    { "port-addr", port_addr_cli, "Find code addresses of one build in another" },
+    { "loc-json", loc_json_cli, "Generate thprac_locale_def.h and .cpp from thprac_games_def.json" },
+    { "bench", bench_cli, "Measure the throughput of the batch code paths" },
+};
+
+int devtools_cli(int argc, char** argv)
+{
+    if (argc >= 2) {
+        for (auto& command : cli_commands) {
+            if (!strcmp(argv[1], command.name))
+                return command.run(argc - 1, argv + 1);
+        }
+    }
+
+    fprintf(stderr, "usage: thprac_devtools <command> [args...]\n\ncommands:\n");
+    for (auto& command : cli_commands)
+        fprintf(stderr, "  %-12s %s\n", command.name, command.description);
+    return 1;
+}
+
+#ifndef _WIN32
+int main(int argc, char** argv)
+{
+    return devtools_cli(argc, argv);
+}
+#endif
@@ -0,0 +1,175 @@
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <util.h>
+#include <pe.h>
+#include <remote_reader.h>
+#include "exe_sig.h"
+#ifdef _WIN32
+#include <tlhelp32.h>
+#endif
+
+// Under Wine that's the mapping of the first .exe in /proc/<pid>/maps
+bool FindProcessMainImage(uint32_t pid, uint64_t& baseOut)
+{
+#ifdef _WIN32
+    HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPMODULE | TH32CS_SNAPMODULE32, pid);
+    if (snapshot == INVALID_HANDLE_VALUE)
+        return false;
+    defer(CloseHandle(snapshot));
+    MODULEENTRY32W module = {};
+    module.dwSize = sizeof(module);
+    if (!Module32FirstW(snapshot, &module))
+        return false;
+    baseOut = (uint64_t)(uintptr_t)module.modBaseAddr;
+    return true;
+#else
+    char mapsFn[64];
+    snprintf(mapsFn, sizeof(mapsFn), "/proc/%u/maps", pid);
+    FILE* maps = fopen(mapsFn, "r");
+    if (!maps)
+        return false;
+    defer(fclose(maps));
+
+    char line[4096];
+    while (fgets(line, sizeof(line), maps)) {
+        unsigned long long start, end, offset;
+        int pathStart = 0;
+        if (sscanf(line, "%llx-%llx %*s %llx %*s %*s %n", &start, &end, &offset, &pathStart) < 3 || !pathStart || offset)
+            continue;
+        size_t length = strcspn(line + pathStart, "\n");
+        const char* path = line + pathStart;
+        if (length > 4 && path[length - 4] == '.' && tolower(path[length - 3]) == 'e' && tolower(path[length - 2]) == 'x' && tolower(path[length - 1]) == 'e') {
+            baseOut = start;
+            return true;
+        }
+    }
+    errno = ENOENT;
+    return false;
+#endif
+}
+
+bool GetProcessImageSig(RemoteReader& reader, uint64_t base, ExeSig& exeSigOut)
+{
+    // First round trip: the header page
+    uint8_t head[RemoteReader::READ_PAGE_SIZE];
+    if (!reader.Read(base, head, sizeof(head)))
+        return false;
+    PeView headView(head, sizeof(head), PeLayout::Image);
+    if (!headView.IsValid())
+        return false;
+    const PeOptionalHeader32& optionalHeader = headView.ntHeaders->OptionalHeader;
+    uint32_t imageSize = optionalHeader.SizeOfImage;
+    uint32_t headersSize = optionalHeader.SizeOfHeaders;
+    if (imageSize < sizeof(head) || imageSize > (1u << 30) || headersSize > imageSize)
+        return false;
+
+    // Only the parts GetExeImageSig looks at are filled in, the rest of the
+    // image stays zero
+    std::vector<uint8_t> image(imageSize);
+    memcpy(image.data(), head, sizeof(head));
+    PeView exe(image.data(), image.size(), PeLayout::Image);
+    // The rest of the headers joins the second batch. Only a section table
+    // that runs past the first page has to be read before .text can be
+    // found, which costs a round trip of its own.
+    if (headersSize > sizeof(head)) {
+        reader.Add(base + sizeof(head), image.data() + sizeof(head), headersSize - sizeof(head));
+        if (headView.numSections < headView.ntHeaders->FileHeader.NumberOfSections && !reader.Flush())
+            return false;
+    }
+
+    // Second round trip: the rest of the headers, entry point code and .text
+    // in one batch
+    uint32_t textStart = 0, textEnd = 0;
+    if (auto text = exe.FindSection(".text")) {
+        textStart = text->VirtualAddress;
+        textEnd = textStart + PeView::SectionDataSize(*text);
+        if (textEnd > imageSize || textEnd < textStart)
+            return false;
+        reader.Add(base + textStart, image.data() + textStart, textEnd - textStart);
+    }
+    uint32_t oep = optionalHeader.AddressOfEntryPoint;
+    bool oepInText = oep >= textStart && oep <= textEnd && textEnd - oep >= EXE_OEP_SIZE;
+    if (!oepInText && oep < imageSize && imageSize - oep >= EXE_OEP_SIZE)
+        reader.Add(base + oep, image.data() + oep, EXE_OEP_SIZE);
+    if (!reader.Flush())
+        return false;
+
+    return GetExeImageSig(exe, exeSigOut);
+}
+
+static void PrintImageSigUsage()
+{
+    fprintf(stderr,
+        "usage: image-sig [--base address] [--stats] <pid>...\n"
+        "       image-sig --file <file>...\n"
+        "  Prints the image signature of a running game, read from its memory, or\n"
+        "  the one a game file will have once loaded. The hash only covers .text.\n"
+        "  --stats  report the system calls each batch of memory reads took\n");
+}
+
+int image_sig_cli(int argc, char** argv)
+{
+    uint64_t base = 0;
+    bool files = false;
+    bool stats = false;
+    std::vector<const char*> targets;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--base") && i + 1 < argc) {
+            base = strtoull(argv[++i], NULL, 16);
+        } else if (!strcmp(argv[i], "--stats")) {
+            stats = true;
+        } else if (!strcmp(argv[i], "--file")) {
+            files = true;
+        } else if (argv[i][0] == '-') {
+            PrintImageSigUsage();
+            return 1;
+        } else {
+            targets.push_back(argv[i]);
+        }
+    }
+    if (targets.empty() || (files && base)) {
+        PrintImageSigUsage();
+        return 1;
+    }
+
+    int failed = 0;
+    std::string output;
+    for (auto target : targets) {
+        ExeSig sig;
+        bool ok;
+        if (files) {
+            MappedFile file(target);
+            ok = file.fileMapView && GetExeImageSig(PeView(file.fileMapView, file.fileSize), sig);
+        } else {
+            uint32_t pid = (uint32_t)strtoul(target, NULL, 10);
+            uint64_t imageBase = base;
+            RemoteReader reader(pid);
+            reader.batchLog = stats ? stderr : nullptr;
+            errno = 0;
+            ok = reader.IsOpen() && (imageBase || FindProcessMainImage(pid, imageBase)) && GetProcessImageSig(reader, imageBase, sig);
+            if (stats) {
+                fprintf(stderr, "total: %zu reads, %zu from cache, %zu syscalls, %llu bytes\n",
+                    reader.total.requests, reader.total.cacheHits, reader.total.syscalls, (unsigned long long)reader.total.bytesRead);
+            }
+        }
+        if (!ok) {
+            if (files || !errno)
+                fprintf(stderr, "Error: Couldn't read the image of %s\n", target);
+            else
+                fprintf(stderr, "Error: Couldn't read the image of process %s: %s\n", target, strerror(errno));
+            failed++;
+            continue;
+        }
+        output += files ? "    // " : "    // pid ";
+        output += target;
+        output += "\n";
+        FormatExeSig(output, sig);
+        output += "\n";
+    }
+    fwrite(output.data(), 1, output.size(), stdout);
+    return failed ? 1 : 0;
+}
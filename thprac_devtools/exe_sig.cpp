@@ -1,37 +1,20 @@
-#include <Windows.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <algorithm>
 #include "metrohash128.h"
 #include <util.h>
-#include "window.h"
-
-struct ExeSig {
-    uint32_t timeStamp;
-    uint32_t textSize;
-    uint32_t oepCode[10];
-    uint32_t metroHash[4];
-};
+#include <pe.h>
+#include "exe_sig.h"
 
-bool ReadMemory(void* buffer, void* addr, size_t size)
+// Fills in everything but oepCode and metroHash. `oepOffset` receives the
+// file offset of the entry point code, or SIZE_MAX if no section holds it.
+static bool ReadExeHeaders(const PeView& exe, ExeSig& exeSigOut, size_t& oepOffset)
 {
-    SIZE_T bytesRead = 0;
-    ReadProcessMemory(GetCurrentProcess(), addr, buffer, size, &bytesRead);
-    return bytesRead == size;
-}
-
-bool GetExeInfo(void* exeBuffer, size_t exeSize, ExeSig& exeSigOut)
-{
-    if (exeSize < 128)
+    if (exe.size < 128 || !exe.IsValid())
         return false;
 
-    IMAGE_DOS_HEADER dosHeader;
-    if (!ReadMemory(&dosHeader, exeBuffer, sizeof(IMAGE_DOS_HEADER)) || dosHeader.e_magic != 0x5a4d)
-        return false;
-    IMAGE_NT_HEADERS ntHeader;
-    if (!ReadMemory(&ntHeader, (void*)((DWORD)exeBuffer + dosHeader.e_lfanew), sizeof(IMAGE_NT_HEADERS)) || ntHeader.Signature != 0x00004550)
-        return false;
-
-    exeSigOut.timeStamp = ntHeader.FileHeader.TimeDateStamp;
+    exeSigOut.timeStamp = exe.ntHeaders->FileHeader.TimeDateStamp;
     exeSigOut.textSize = 0;
     for (auto& codeBlock : exeSigOut.oepCode) {
         codeBlock = 0;
@@ -39,40 +22,226 @@ bool GetExeInfo(void* exeBuffer, size_t exeSize, ExeSig& exeSigOut)
     for (auto& hashBlock : exeSigOut.metroHash) {
         hashBlock = 0;
     }
+    oepOffset = SIZE_MAX;
 
-    PIMAGE_SECTION_HEADER pSection = (PIMAGE_SECTION_HEADER)((ULONG_PTR)((LONG)exeBuffer + dosHeader.e_lfanew) + ((LONG)(LONG_PTR) & (((IMAGE_NT_HEADERS*)0)->OptionalHeader)) + ntHeader.FileHeader.SizeOfOptionalHeader);
-    for (int i = 0; i < ntHeader.FileHeader.NumberOfSections; i++, pSection++) {
-        IMAGE_SECTION_HEADER section;
-        if (!ReadMemory(&section, pSection, sizeof(IMAGE_SECTION_HEADER)))
-            continue;
-        if (!strcmp(".text", (char*)section.Name)) {
+    // NOTE: Not PeView::RvaToOffset, the signatures were always generated with
+    // an inclusive end check and the last matching section winning.
+    uint32_t oep = exe.ntHeaders->OptionalHeader.AddressOfEntryPoint;
+    for (unsigned int i = 0; i < exe.numSections; i++) {
+        const PeSectionHeader& section = exe.sections[i];
+        if (PeView::SectionNameIs(section, ".text")) {
             exeSigOut.textSize = section.SizeOfRawData;
         }
-        DWORD pOepCode = ntHeader.OptionalHeader.AddressOfEntryPoint;
-        if (pOepCode >= section.VirtualAddress && pOepCode <= (section.VirtualAddress + section.Misc.VirtualSize)) {
-            pOepCode -= section.VirtualAddress;
-            pOepCode += section.PointerToRawData;
-            pOepCode += (DWORD)exeBuffer;
-
-            uint16_t oepCode[10];
-            if (!ReadMemory(&oepCode, (void*)pOepCode, sizeof(oepCode)))
-                continue;
-
-            for (unsigned int j = 0; j < 10; ++j) {
-                exeSigOut.oepCode[j] = (uint32_t) * (oepCode + j);
-                exeSigOut.oepCode[j] ^= (j + 0x41) | ((j + 0x41) << 8);
-            }
+        if (oep >= section.VirtualAddress && oep <= (section.VirtualAddress + section.Misc.VirtualSize)) {
+            oepOffset = oep - section.VirtualAddress + section.PointerToRawData;
         }
     }
 
-    if (exeSize < (1 << 23)) {
-        MetroHash128::Hash((uint8_t*)exeBuffer, exeSize, (uint8_t*)exeSigOut.metroHash);
+    return true;
+}
+
+static void SetOepCode(ExeSig& exeSigOut, const uint8_t* oepBytes)
+{
+    uint16_t oepCode[10];
+    memcpy(oepCode, oepBytes, sizeof(oepCode));
+    for (unsigned int j = 0; j < 10; ++j) {
+        exeSigOut.oepCode[j] = (uint32_t) * (oepCode + j);
+        exeSigOut.oepCode[j] ^= (j + 0x41) | ((j + 0x41) << 8);
+    }
+}
+
+bool GetExeHeaderInfo(const void* exeBuffer, size_t exeSize, ExeSig& exeSigOut)
+{
+    PeView exe(exeBuffer, exeSize);
+    size_t oepOffset;
+    if (!ReadExeHeaders(exe, exeSigOut, oepOffset))
+        return false;
+    if (auto oepBytes = exe.At<uint8_t>(oepOffset, EXE_OEP_SIZE))
+        SetOepCode(exeSigOut, oepBytes);
+    return true;
+}
+
+bool GetExeInfo(void* exeBuffer, size_t exeSize, ExeSig& exeSigOut)
+{
+    if (!GetExeHeaderInfo(exeBuffer, exeSize, exeSigOut))
+        return false;
+    MetroHash128::Hash((uint8_t*)exeBuffer, exeSize, (uint8_t*)exeSigOut.metroHash);
+    return true;
+}
+
+bool HashFileStreaming(WindowedFile& file, uint32_t metroHashOut[4])
+{
+    MetroHash128 hasher;
+    for (uint64_t offset = 0; offset < file.fileSize; offset += EXE_HASH_WINDOW) {
+        size_t size = (size_t)std::min<uint64_t>(EXE_HASH_WINDOW, file.fileSize - offset);
+        const uint8_t* window = file.Map(offset, size);
+        if (!window)
+            return false;
+        hasher.Update(window, size);
+    }
+    hasher.Finalize((uint8_t*)metroHashOut);
+    return true;
+}
+
+bool GetExeHeaderInfoFromFile(WindowedFile& file, ExeSig& exeSigOut)
+{
+    size_t headSize = (size_t)std::min<uint64_t>(file.fileSize, EXE_HASH_WINDOW);
+    const uint8_t* head = file.Map(0, headSize);
+    size_t oepOffset;
+    if (!head || !ReadExeHeaders(PeView(head, headSize), exeSigOut, oepOffset))
+        return false;
+    if (oepOffset != SIZE_MAX) {
+        if (const uint8_t* oepBytes = file.Map(oepOffset, EXE_OEP_SIZE))
+            SetOepCode(exeSigOut, oepBytes);
+    }
+    return true;
+}
+
+bool GetExeInfoFromFile(const char* fn, ExeSig& exeSigOut)
+{
+    WindowedFile file(fn);
+    return GetExeHeaderInfoFromFile(file, exeSigOut) && HashFileStreaming(file, exeSigOut.metroHash);
+}
+
+void FormatExeSig(std::string& output, const ExeSig& sig)
+{
+    char exeSig[2048];
+    snprintf(exeSig, sizeof(exeSig),
+        "    { \"idstr\",\n"
+        "        L\"steam_appid\",\n"
+        "        GAMEID_TITLE,\n"
+        "        CAT,\n"
+        "        L\"vpatch_dll\",\n"
+        "        L\"%%APPDATA%%\\\\ShanghaiAlice\\\\gameid\",\n"
+        "        Init,\n"
+        "        { %d, %d,\n"
+        "            { 0x%4x, 0x%4x, 0x%4x, 0x%4x, 0x%4x,\n"
+        "                0x%4x, 0x%4x, 0x%4x, 0x%4x, 0x%4x },\n"
+        "            { 0x%8x, 0x%8x,\n"
+        "                0x%8x, 0x%8x } } },",
+
+        sig.timeStamp, sig.textSize,
+        sig.oepCode[0], sig.oepCode[1], sig.oepCode[2], sig.oepCode[3], sig.oepCode[4],
+        sig.oepCode[5], sig.oepCode[6], sig.oepCode[7], sig.oepCode[8], sig.oepCode[9],
+        sig.metroHash[0], sig.metroHash[1], sig.metroHash[2], sig.metroHash[3]
+    );
+    output += exeSig;
+}
+
+bool GetExeImageSig(const PeView& exe, ExeSig& exeSigOut)
+{
+    if (!exe.IsValid())
+        return false;
+    exeSigOut = {};
+    exeSigOut.timeStamp = exe.ntHeaders->FileHeader.TimeDateStamp;
+    uint64_t oepOffset = exe.RvaToOffset(exe.ntHeaders->OptionalHeader.AddressOfEntryPoint);
+    if (auto oepBytes = exe.At<uint8_t>(oepOffset, EXE_OEP_SIZE))
+        SetOepCode(exeSigOut, oepBytes);
+    if (auto text = exe.FindSection(".text")) {
+        exeSigOut.textSize = text->SizeOfRawData;
+        const uint8_t* textData = exe.SectionData(*text);
+        if (!textData)
+            return false;
+        MetroHash128::Hash(textData, PeView::SectionDataSize(*text), (uint8_t*)exeSigOut.metroHash);
+    }
+    return true;
+}
+
+static void InitSectionHash(ExeSectionHash& hash, const PeSectionHeader& section)
+{
+    memcpy(hash.name, section.Name, sizeof(hash.name));
+    hash.rva = section.VirtualAddress;
+    hash.size = PeView::SectionDataSize(section);
+}
+
+static const PeSectionHeader* FindSectionAt(const PeView& exe, const ExeSectionHash& hash)
+{
+    for (unsigned int i = 0; i < exe.numSections; i++) {
+        const PeSectionHeader& section = exe.sections[i];
+        if (section.VirtualAddress == hash.rva && !memcmp(section.Name, hash.name, sizeof(hash.name)))
+            return &section;
+    }
+    return nullptr;
+}
+
+bool GetExeSectionHashes(const PeView& exe, std::vector<ExeSectionHash>& hashesOut)
+{
+    hashesOut.clear();
+    if (!exe.IsValid())
+        return false;
+    for (unsigned int i = 0; i < exe.numSections; i++) {
+        ExeSectionHash hash;
+        InitSectionHash(hash, exe.sections[i]);
+        const uint8_t* data = exe.SectionData(exe.sections[i]);
+        if (!data)
+            return false;
+        MetroHash128::Hash(data, hash.size, (uint8_t*)hash.metroHash);
+        hashesOut.push_back(hash);
     }
+    return true;
+}
+
+bool GetExeSectionHashesFromFile(WindowedFile& file, std::vector<ExeSectionHash>& hashesOut)
+{
+    hashesOut.clear();
+    size_t headSize = (size_t)std::min<uint64_t>(file.fileSize, EXE_HASH_WINDOW);
+    const uint8_t* head = file.Map(0, headSize);
+    if (!head)
+        return false;
+    // Copied, mapping the sections moves the window away from the headers
+    PeView headView(head, headSize);
+    if (!headView.IsValid())
+        return false;
+    std::vector<PeSectionHeader> sections(headView.sections, headView.sections + headView.numSections);
 
+    for (auto& section : sections) {
+        ExeSectionHash hash;
+        InitSectionHash(hash, section);
+        if ((uint64_t)section.PointerToRawData + hash.size > file.fileSize)
+            return false;
+        MetroHash128 hasher;
+        for (uint32_t done = 0; done < hash.size;) {
+            size_t size = std::min<size_t>(EXE_HASH_WINDOW, hash.size - done);
+            const uint8_t* window = file.Map((uint64_t)section.PointerToRawData + done, size);
+            if (!window)
+                return false;
+            hasher.Update(window, size);
+            done += (uint32_t)size;
+        }
+        hasher.Finalize((uint8_t*)hash.metroHash);
+        hashesOut.push_back(hash);
+    }
     return true;
 }
 
+bool VerifyExeSectionHash(const PeView& exe, const ExeSectionHash& hash)
+{
+    const PeSectionHeader* section = FindSectionAt(exe, hash);
+    if (!section || PeView::SectionDataSize(*section) != hash.size)
+        return false;
+    const uint8_t* data = exe.SectionData(*section);
+    if (!data)
+        return false;
+    uint32_t metroHash[4];
+    MetroHash128::Hash(data, hash.size, (uint8_t*)metroHash);
+    return !memcmp(metroHash, hash.metroHash, sizeof(metroHash));
+}
+
+void FormatExeSectionHashes(std::string& output, const std::vector<ExeSectionHash>& hashes)
+{
+    char line[256];
+    for (auto& hash : hashes) {
+        snprintf(line, sizeof(line),
+            "    // { \"%.8s\", 0x%08x, 0x%08x, { 0x%08x, 0x%08x, 0x%08x, 0x%08x } },\n",
+            hash.name, hash.rva, hash.size,
+            hash.metroHash[0], hash.metroHash[1], hash.metroHash[2], hash.metroHash[3]);
+        output += line;
+    }
+}
+
+#ifdef _WIN32
 #include <imgui.h>
+#include "window.h"
 
 void exe_sig_gui() {
     static char exeSig[2048] = {};
@@ -92,47 +261,15 @@ void exe_sig_gui() {
     ImGui::SameLine();
     ImGui::TextUnformatted(exeFn ? exeFn : "");
     if (ImGui::Button("Generate") && exeFn) {
-        HANDLE hFile = CreateFileW(utf8_to_utf16(exeFn).c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-        if (hFile == INVALID_HANDLE_VALUE) {
-            MessageBoxW(GuiGetWindow(), L"Failed to open file", L"Couldn't generate exe signature", MB_ICONERROR);
-            goto after_generate_button;
-        }
-        defer(CloseHandle(hFile));
-        SIZE_T fileSize = GetFileSize(hFile, NULL);
-        HANDLE hFileMap = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, fileSize, NULL);
-        if (!hFileMap) {
-            MessageBoxW(GuiGetWindow(), L"Failed to create file mapping", L"Couldn't generate exe signature", MB_ICONERROR);
-            goto after_generate_button;
-        }
-        defer(CloseHandle(hFileMap));
-        void* pFileMapView = MapViewOfFile(hFileMap, FILE_MAP_READ, 0, 0, fileSize);
-        if (!pFileMapView) {
-            MessageBoxW(GuiGetWindow(), L"Failed to map file to memory", L"Couldn't generate exe signature", MB_ICONERROR);
+        ExeSig out;
+        if (!GetExeInfoFromFile(exeFn, out)) {
+            MessageBoxW(GuiGetWindow(), L"Failed to read file, or it isn't an executable", L"Couldn't generate exe signature", MB_ICONERROR);
             goto after_generate_button;
         }
-        defer(UnmapViewOfFile(pFileMapView));
-        ExeSig out;
-        GetExeInfo(pFileMapView, fileSize, out);
-
-        sprintf_s(exeSig,
-            "    { \"idstr\",\n"
-            "        L\"steam_appid\",\n"
-            "        GAMEID_TITLE,\n"
-            "        CAT,\n"
-            "        L\"vpatch_dll\",\n"
-            "        L\"%%APPDATA%%\\\\ShanghaiAlice\\\\gameid\",\n"
-            "        Init,\n"
-            "        { %d, %d,\n"
-            "            { 0x%4x, 0x%4x, 0x%4x, 0x%4x, 0x%4x,\n"
-            "                0x%4x, 0x%4x, 0x%4x, 0x%4x, 0x%4x },\n"
-            "            { 0x%8x, 0x%8x,\n"
-            "                0x%8x, 0x%8x } } },",
-
-            out.timeStamp, out.textSize,
-            out.oepCode[0], out.oepCode[1], out.oepCode[2], out.oepCode[3], out.oepCode[4],
-            out.oepCode[5], out.oepCode[6], out.oepCode[7], out.oepCode[8], out.oepCode[9],
-            out.metroHash[0], out.metroHash[1], out.metroHash[2], out.metroHash[3]
-        );
+
+        std::string exeSigText;
+        FormatExeSig(exeSigText, out);
+        snprintf(exeSig, sizeof(exeSig), "%s", exeSigText.c_str());
     }
     after_generate_button:
     ImGui::NewLine();
@@ -141,3 +278,4 @@ void exe_sig_gui() {
     ImGui::InputTextMultiline("exeSig", exeSig, 2048, { wndSize.x, wndSize.y });
     ImGui::EndChild();
 }
+#endif
@@ -0,0 +1,92 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct ExeSig {
+    uint32_t timeStamp;
+    uint32_t textSize;
+    uint32_t oepCode[10];
+    uint32_t metroHash[4];
+};
+
+struct WindowedFile;
+
+// Bytes of entry point code that go into oepCode
+constexpr size_t EXE_OEP_SIZE = 10 * sizeof(uint16_t);
+// Files are hashed this many bytes at a time. Small enough to always find
+// room for it in a 32-bit address space.
+constexpr size_t EXE_HASH_WINDOW = 16 << 20;
+
+bool GetExeInfo(void* exeBuffer, size_t exeSize, ExeSig& exeSigOut);
+// GetExeInfo minus the hash, for callers that hash in bulk. metroHash is zeroed.
+bool GetExeHeaderInfo(const void* exeBuffer, size_t exeSize, ExeSig& exeSigOut);
+// Same result as GetExeInfo over the whole file, but never maps more than
+// EXE_HASH_WINDOW bytes at once
+bool GetExeInfoFromFile(const char* fn, ExeSig& exeSigOut);
+// GetExeHeaderInfo straight from a file. Only touches the header and entry
+// point pages, however big the file is.
+bool GetExeHeaderInfoFromFile(WindowedFile& file, ExeSig& exeSigOut);
+bool HashFileStreaming(WindowedFile& file, uint32_t metroHashOut[4]);
+
+// Appends the thprac game table initializer template for `sig`
+void FormatExeSig(std::string& output, const ExeSig& sig);
+
+// MetroHash128 of one section's PeView::SectionDataSize() bytes. Those read
+// the same on disk and in the loaded module, so a running game's code can be
+// checked against this without touching the file, and a patched resource
+// section doesn't affect the hash of .text.
+struct ExeSectionHash {
+    char name[8]; // not null terminated if all 8 bytes are used
+    uint32_t rva;
+    uint32_t size;
+    uint32_t metroHash[4];
+};
+
+struct PeView;
+
+// Works on both file and image layout views
+bool GetExeSectionHashes(const PeView& exe, std::vector<ExeSectionHash>& hashesOut);
+bool GetExeSectionHashesFromFile(WindowedFile& file, std::vector<ExeSectionHash>& hashesOut);
+// Checks one section of `exe` against `hash`, e.g. .text of a loaded module
+bool VerifyExeSectionHash(const PeView& exe, const ExeSectionHash& hash);
+// Appends `hashes` as a commented list of initializers
+void FormatExeSectionHashes(std::string& output, const std::vector<ExeSectionHash>& hashes);
+
+// "Image signature": the ExeSig header fields and oepCode, but metroHash
+// covers only the .text section data. Unlike the file hash that can be
+// computed from a running process, and it's the same for a file and its
+// loaded image as long as .text wasn't relocated or patched.
+bool GetExeImageSig(const PeView& exe, ExeSig& exeSigOut);
+struct RemoteReader;
+
+// Where the main exe of process `pid` is loaded
+bool FindProcessMainImage(uint32_t pid, uint64_t& baseOut);
+// Reads the image loaded at `base` through `reader`, in two round trips
+bool GetProcessImageSig(RemoteReader& reader, uint64_t base, ExeSig& exeSigOut);
+
+struct ExeSigResult {
+    std::string path;
+    ExeSig sig;
+};
+
+struct SigCache;
+
+struct ExeSigScanStats {
+    size_t cached; // results taken from the cache without reading the file
+    size_t stale; // cache entries that disagreed with a fresh scan
+};
+
+// Recursively collects every .exe below `roots`. Plain files given in `roots`
+// are always taken. With `allFiles`, the extension filter is dropped.
+std::vector<std::string> FindExeFiles(const std::vector<std::string>& roots, bool allFiles);
+
+// Runs GetExeInfo over `files` on `numThreads` workers (0 = one per core).
+// Files that fit in one hash window are hashed MetroHash128MB::Lanes() at a
+// time. Files that aren't PE images are left out; the result is sorted by path.
+// With a `cache`, files whose size and mtime are unchanged are not read, and
+// everything that was read is stored back. `verifyCache` reads every file
+// anyway and counts the entries that turned out wrong in `stats`.
+std::vector<ExeSigResult> ScanExeSigs(const std::vector<std::string>& files, unsigned int numThreads,
+    SigCache* cache = nullptr, bool verifyCache = false, ExeSigScanStats* stats = nullptr);
@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <util.h>
+#include <parallel.h>
+#include "metrohash128mb.h"
+#include "exe_sig.h"
+#include "sig_cache.h"
+#include "sig_db.h"
+
+namespace fs = std::filesystem;
+
+static bool IsExeExtension(const fs::path& path)
+{
+    std::string ext = path.extension().u8string();
+    for (auto& c : ext)
+        c = (char)tolower((unsigned char)c);
+    return ext == ".exe";
+}
+
+std::vector<std::string> FindExeFiles(const std::vector<std::string>& roots, bool allFiles)
+{
+    std::vector<std::string> files;
+    for (auto& root : roots) {
+        std::error_code ec;
+        fs::path rootPath = fs::u8path(root);
+        if (fs::is_regular_file(rootPath, ec)) {
+            files.push_back(root);
+            continue;
+        }
+        fs::recursive_directory_iterator it(rootPath, fs::directory_options::skip_permission_denied, ec);
+        for (; !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+            if (!it->is_regular_file(ec))
+                continue;
+            if (allFiles || IsExeExtension(it->path()))
+                files.push_back(it->path().u8string());
+        }
+        if (ec)
+            fprintf(stderr, "Warning: Couldn't walk %s: %s\n", root.c_str(), ec.message().c_str());
+    }
+    std::sort(files.begin(), files.end());
+    files.erase(std::unique(files.begin(), files.end()), files.end());
+    return files;
+}
+
+static std::string CacheKey(const std::string& file)
+{
+    std::error_code ec;
+    fs::path path = fs::weakly_canonical(fs::u8path(file), ec);
+    return ec ? file : path.u8string();
+}
+
+std::vector<ExeSigResult> ScanExeSigs(const std::vector<std::string>& files, unsigned int numThreads,
+    SigCache* cache, bool verifyCache, ExeSigScanStats* stats)
+{
+    ExeSigScanStats scanStats = {};
+    std::vector<ExeSig> sigs(files.size());
+    std::vector<char> isPe(files.size());
+    std::vector<uint64_t> sizes(files.size());
+    std::vector<int64_t> mtimes(files.size());
+    std::vector<std::string> keys(cache ? files.size() : 0);
+    std::vector<size_t> order;
+    order.reserve(files.size());
+    for (size_t i = 0; i < files.size(); i++) {
+        std::error_code ec;
+        fs::path path = fs::u8path(files[i]);
+        sizes[i] = fs::file_size(path, ec);
+        if (cache) {
+            mtimes[i] = (int64_t)fs::last_write_time(path, ec).time_since_epoch().count();
+            keys[i] = CacheKey(files[i]);
+            const SigCacheEntry* entry = cache->Find(keys[i], sizes[i], mtimes[i]);
+            if (entry && !verifyCache) {
+                sigs[i] = entry->sig;
+                isPe[i] = entry->isPe;
+                scanStats.cached++;
+                continue;
+            }
+        }
+        order.push_back(i);
+    }
+
+    // Biggest files first. Keeps the multi-buffer groups at similar sizes,
+    // and the stragglers at the end short.
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return sizes[a] > sizes[b];
+    });
+
+    // Files hashed together in one multi-buffer call, [groups[k], groups[k + 1])
+    // of `order`. A group is mapped all at once, so it never holds more than
+    // EXE_HASH_WINDOW bytes, the same bound GetExeInfoFromFile keeps. Files
+    // bigger than that are signed window by window in a group of their own.
+    const size_t lanes = MetroHash128MB::Lanes();
+    std::vector<size_t> groups;
+    uint64_t groupBytes = 0;
+    for (size_t j = 0; j < order.size(); j++) {
+        uint64_t size = sizes[order[j]];
+        if (groups.empty() || j - groups.back() == lanes || groupBytes + size > EXE_HASH_WINDOW) {
+            groups.push_back(j);
+            groupBytes = 0;
+        }
+        groupBytes += size;
+    }
+    groups.push_back(order.size());
+    std::atomic<size_t> nextGroup { 0 };
+
+    RunThreads(ThreadCount(numThreads, groups.size() - 1), [&](unsigned int) {
+        std::vector<std::unique_ptr<WindowedFile>> mapped;
+        std::vector<const uint8_t*> buffers;
+        std::vector<uint64_t> lengths;
+        std::vector<uint8_t*> hashes;
+        for (size_t k; (k = nextGroup.fetch_add(1)) + 1 < groups.size();) {
+            mapped.clear();
+            buffers.clear();
+            lengths.clear();
+            hashes.clear();
+            for (size_t j = groups[k]; j < groups[k + 1]; j++) {
+                size_t i = order[j];
+                if (sizes[i] > EXE_HASH_WINDOW) {
+                    isPe[i] = GetExeInfoFromFile(files[i].c_str(), sigs[i]);
+                    continue;
+                }
+                auto file = std::make_unique<WindowedFile>(files[i].c_str());
+                const uint8_t* view = file->Map(0, (size_t)file->fileSize);
+                if (!view || !GetExeHeaderInfo(view, (size_t)file->fileSize, sigs[i]))
+                    continue;
+                isPe[i] = true;
+                buffers.push_back(view);
+                lengths.push_back(file->fileSize);
+                hashes.push_back((uint8_t*)sigs[i].metroHash);
+                mapped.push_back(std::move(file));
+            }
+            MetroHash128MB::Hash(buffers.data(), lengths.data(), hashes.data(), buffers.size());
+        }
+    });
+
+    if (cache) {
+        for (size_t i : order) {
+            SigCacheEntry entry = { sizes[i], mtimes[i], isPe[i] != 0, isPe[i] ? sigs[i] : ExeSig {} };
+            const SigCacheEntry* old = cache->Find(keys[i], sizes[i], mtimes[i]);
+            if (old && (old->isPe != entry.isPe || (entry.isPe && memcmp(&old->sig, &entry.sig, sizeof(ExeSig))))) {
+                fprintf(stderr, "Warning: Cached signature of %s was stale\n", files[i].c_str());
+                scanStats.stale++;
+            }
+            cache->Store(keys[i], entry);
+        }
+    }
+    if (stats)
+        *stats = scanStats;
+
+    std::vector<ExeSigResult> results;
+    for (size_t i = 0; i < files.size(); i++) {
+        if (isPe[i])
+            results.push_back({ files[i], sigs[i] });
+    }
+    std::sort(results.begin(), results.end(), [](const ExeSigResult& a, const ExeSigResult& b) {
+        return a.path < b.path;
+    });
+    return results;
+}
+
+static void PrintExeSigUsage()
+{
+    fprintf(stderr,
+        "usage: exe-sig [-j threads] [-o output] [--all] [--cache file [--verify]] [--db file] [--sections] <file|dir>...\n"
+        "  Signs every .exe below the given paths and writes all the game table\n"
+        "  initializers in one go (to stdout unless -o is given).\n"
+        "  --all      try every file, not just .exe (non-PE files are skipped)\n"
+        "  --cache    reuse signatures of files whose size and mtime haven't changed\n"
+        "  --verify   sign every file anyway and report cache entries that were wrong\n"
+        "  --db       also write the signatures as a database for identify\n"
+        "  --sections list a hash of every section below each signature\n");
+}
+
+int exe_sig_cli(int argc, char** argv)
+{
+    unsigned int numThreads = 0;
+    const char* outputFn = NULL;
+    const char* cacheFn = NULL;
+    const char* dbFn = NULL;
+    bool allFiles = false;
+    bool verifyCache = false;
+    bool sectionHashes = false;
+    std::vector<std::string> roots;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            numThreads = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            outputFn = argv[++i];
+        } else if (!strcmp(argv[i], "--all")) {
+            allFiles = true;
+        } else if (!strcmp(argv[i], "--cache") && i + 1 < argc) {
+            cacheFn = argv[++i];
+        } else if (!strcmp(argv[i], "--db") && i + 1 < argc) {
+            dbFn = argv[++i];
+        } else if (!strcmp(argv[i], "--sections")) {
+            sectionHashes = true;
+        } else if (!strcmp(argv[i], "--verify")) {
+            verifyCache = true;
+        } else if (argv[i][0] == '-') {
+            PrintExeSigUsage();
+            return 1;
+        } else {
+            roots.push_back(argv[i]);
+        }
+    }
+    if (roots.empty() || (verifyCache && !cacheFn)) {
+        PrintExeSigUsage();
+        return 1;
+    }
+
+    SigCache cache;
+    if (cacheFn && !cache.Load(cacheFn))
+        fprintf(stderr, "Warning: %s is not a valid signature cache, rebuilding it\n", cacheFn);
+
+    auto start = std::chrono::steady_clock::now();
+    auto files = FindExeFiles(roots, allFiles);
+    ExeSigScanStats stats;
+    auto results = ScanExeSigs(files, numThreads, cacheFn ? &cache : nullptr, verifyCache, &stats);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (cacheFn && !cache.Save(cacheFn))
+        fprintf(stderr, "Warning: Couldn't write signature cache %s\n", cacheFn);
+    if (dbFn && !SigDb::Write(dbFn, results)) {
+        fprintf(stderr, "Error: Couldn't write signature database %s\n", dbFn);
+        return 1;
+    }
+
+    std::string output;
+    for (auto& result : results) {
+        output += "    // ";
+        output += result.path;
+        output += "\n";
+        FormatExeSig(output, result.sig);
+        output += "\n";
+        if (sectionHashes) {
+            WindowedFile file(result.path.c_str());
+            std::vector<ExeSectionHash> hashes;
+            if (GetExeSectionHashesFromFile(file, hashes))
+                FormatExeSectionHashes(output, hashes);
+            else
+                fprintf(stderr, "Warning: Couldn't hash the sections of %s\n", result.path.c_str());
+        }
+    }
+
+    FILE* out = outputFn ? OpenFileUtf8(outputFn, "wb") : stdout;
+    if (!out) {
+        fprintf(stderr, "Error: Couldn't open %s for writing\n", outputFn);
+        return 1;
+    }
+    fwrite(output.data(), 1, output.size(), out);
+    if (out != stdout)
+        fclose(out);
+
+    fprintf(stderr, "Signed %zu of %zu files in %.3fs\n", results.size(), files.size(), seconds);
+    if (cacheFn && verifyCache)
+        fprintf(stderr, "%zu stale cache entries\n", stats.stale);
+    else if (cacheFn)
+        fprintf(stderr, "%zu of %zu files from cache\n", stats.cached, files.size());
+    return 0;
+}
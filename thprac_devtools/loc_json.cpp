@@ -1,35 +1,37 @@
-﻿#include <Windows.h>
-#include "rapidjson/document.h"
+﻿#ifdef _WIN32
+#include <Windows.h>
+#endif
+#include "rapidjson/reader.h"
+#include <cstdarg>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <cstdio>
-#include <functional>
+#include <cstdlib>
+#include <cstring>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
-#include <set>
-#include <locale>
-#include <codecvt>
+#include <memory>
 #include <unordered_map>
 #include "util.h"
+#include "parallel.h"
+#include "loc_json.h"
+#include "text_writer.h"
+#ifdef _WIN32
 #include "window.h"
-
-using rapidjson::Document;
+#endif
 
 // Collections
 using std::vector;
 using std::map;
 using std::unordered_map;
-using std::set;
-using std::pair;
 
 // Strings
 using std::string;
-using std::wstring;
-using std::wstring_convert;
-using std::codecvt_utf8;
-
-// Function object
-using std::function;
+using std::string_view;
 
 int vsprintf_append(std::string& str, const char* format, va_list va) {
 	va_list va2;
@@ -49,17 +51,7 @@ int vsprintf_append(std::string& str, const char* format, va_list va) {
 	return ret;
 }
 
-int sprintf_append(std::string& str, const char* format, ...) {
-	va_list va;
-	va_start(va, format);
-	int ret = vsprintf_append(str, format, va);
-	va_end(va);
-	return ret;
-}
-
-std::string warnings;
-
-int printf_warn(const char* format, ...) {
+int printf_warn(std::string& warnings, const char* format, ...) {
 	va_list va;
 	va_start(va, format);
 	int ret = vsprintf_append(warnings, format, va);
@@ -68,24 +60,14 @@ int printf_warn(const char* format, ...) {
 }
 
 #define ENDL "\n" // TODO: Would CRLF be preferable?
-#define SKIP_IF(statement, warning, ...) \
-if (statement) \
-{\
-	printf_warn(warning, __VA_ARGS__); \
-	printf_warn(ENDL); \
-	continue; \
-}
-#define BREAK_IF(statement, warning, ...) \
+#define BREAK_IF(statement, warnings, warning, ...) \
 if (statement) \
 {\
-	printf_warn(warning, __VA_ARGS__); \
-	printf_warn(ENDL); \
+	printf_warn(warnings, warning, ##__VA_ARGS__); \
+	printf_warn(warnings, ENDL); \
 	break; \
 }
 
-string g_current_game;
-string g_current_section;
-
 constexpr size_t NUM_LANGUAGES = 3;
 
 enum class Language {
@@ -100,7 +82,7 @@ constexpr Language LANGUAGE_LIST[NUM_LANGUAGES] = {
 	Language::Japanese,
 };
 
-const char* const language_to_iso_639_1(Language language) {
+const char* language_to_iso_639_1(Language language) {
 	switch (language) {
 		case Language::Chinese:
 			return "zh";
@@ -110,8 +92,9 @@ const char* const language_to_iso_639_1(Language language) {
 			return "ja";
 		default:
 			// NOTE: Should never execute.
-			printf_warn(
-				"Error: Attempt to convert invalid language to ISO 639-1"
+			fprintf(
+				stderr,
+				"Error: Attempt to convert invalid language to ISO 639-1\n"
 			);
 
 			// We need to default to SOMETHING that won't cause a naming
@@ -120,19 +103,23 @@ const char* const language_to_iso_639_1(Language language) {
 	}
 }
 
+// Strings of the model are views into the in-situ parsed JSON, or into the
+// string arena of the generation, and always NUL-terminated
 struct loc_str_t {
-	string zh_str;
-	string en_str;
-	string ja_str;
+	string_view zh_str;
+	string_view en_str;
+	string_view ja_str;
+	// String pool entry of each language, set by intern_strings()
+	uint32_t pool_id[NUM_LANGUAGES]{};
 
 	loc_str_t() = default;
-	loc_str_t(const char* zh, const char* en, const char* ja):
+	loc_str_t(string_view zh, string_view en, string_view ja):
 		zh_str(zh), en_str(en), ja_str(ja)
 	{
 
 	}
 
-	string& get_language(Language language) {
+	string_view get_language(Language language) const {
 		switch (language) {
 			case Language::Chinese:
 				return zh_str;
@@ -142,9 +129,10 @@ struct loc_str_t {
 				return ja_str;
 			default:
 				// NOTE: This should never execute.
-				printf_warn(
+				fprintf(
+					stderr,
 					"ERROR: Invalid language passed to loc_str_t.get_language()"
-					" - defaulting to Chinese"
+					" - defaulting to Chinese\n"
 				);
 				return zh_str;
 		}
@@ -169,6 +157,46 @@ constexpr Difficulty DIFFICULTY_LIST[MAX_NUM_DIFFICULTIES] = {
 	DIFFICULTY_LUNATIC,
 };
 
+// A JSON value as far as the checks on a thprac_games_def.json look into
+// it. Strings and ints are kept, other values are only told apart from them.
+struct json_scalar_t {
+	enum type_t {
+		OTHER,
+		STRING,
+		INT,
+	};
+
+	type_t type{ OTHER };
+	string_view str;
+	int int_value{ 0 };
+};
+
+// The value of a section switch or a glossary item. Arrays keep their size
+// and first NUM_LANGUAGES items, which is all that is ever looked at.
+struct switch_value_t : json_scalar_t {
+	bool is_array{ false };
+	size_t array_size{ 0 };
+	json_scalar_t items[NUM_LANGUAGES];
+
+	bool is_string() const {
+		return !is_array && type == STRING;
+	}
+	bool is_int() const {
+		return !is_array && type == INT;
+	}
+	// An array of NUM_LANGUAGES values of `item_type`
+	bool is_triple(type_t item_type) const {
+		return
+			is_array &&
+			array_size == NUM_LANGUAGES &&
+			items[0].type == item_type &&
+			items[1].type == item_type &&
+			items[2].type == item_type;
+	}
+};
+
+struct loc_json_ctx_t;
+
 struct section_t {
 	int app_id{ 0 };
 	int bgm_id{ 0 };
@@ -177,108 +205,261 @@ struct section_t {
 	int spell_id{ 0 };
 	int appearance[NUM_LANGUAGES]{ -1, -1, -1 };
 
-	string name;
-	string ref;
+	string_view name;
+	string_view ref;
 	loc_str_t loc_str[MAX_NUM_DIFFICULTIES];
 
-	bool FillWith(rapidjson::Value& sec);
+	// Checks one switch of the section and applies it
+	void ApplySwitch(
+		const char* sw_key,
+		const switch_value_t& sw_value,
+		const loc_json_ctx_t& ctx,
+		string& warnings
+	);
+};
 
-	section_t() = default;
-	section_t(const char* sec_name, rapidjson::Value& sec):
-		name(sec_name)
-	{
-		FillWith(sec);
+// Number of section lists per stage in th_sections_cbt: non-spells, spells
+constexpr size_t CBT_DIMENSION_ONE = 2;
+
+// Everything about a game's tables that isn't text, worked out once by
+// finalize_game() so the header and source emitters only print it.
+// Sections are referred to by their index in game_t::sections.
+struct game_layout_t {
+	// th_sections_cba is [cba_dims[0]][cba_dims[1]][cba_dims[2] + 1]
+	int cba_dims[3]{ 1, 1, 1 };
+	// Flattened cba_dims[0] x cba_dims[1] x cba_dims[2], -1 where empty
+	vector<int> cba;
+
+	// th_sections_cbt is [cba_dims[0]][CBT_DIMENSION_ONE][cbt_dimension_two + 1]
+	size_t cbt_dimension_two{ 0 };
+	// List k = stage * CBT_DIMENSION_ONE + is_spell is
+	// cbt[cbt_start[k]] .. cbt[cbt_start[k + 1] - 1]
+	vector<size_t> cbt_start;
+	vector<int> cbt;
+
+	// Array dimensions of each group, as printed after its name
+	vector<vector<size_t>> group_shapes;
+
+	int& cba_at(int i0, int i1, int i2) {
+		return cba[((size_t) i0 * cba_dims[1] + i1) * cba_dims[2] + i2];
 	}
 };
 
+// A group is an enum value or a list of them. Anything else, nested lists
+// included, is dropped with a warning.
+struct group_t {
+	string_view name;
+	bool is_array{ false };
+	// Cleared while reading a list when an item isn't a string
+	bool valid{ true };
+	// A single value is items[0]
+	vector<string_view> items;
+};
+
+// Warnings of a game by what they are about. They are collected in this
+// order, whatever order the game's members come in.
+enum game_warnings_t {
+	WARN_GAME,
+	WARN_NAMESPACE,
+	WARN_GLOSSARY,
+	WARN_SECTIONS,
+	WARN_GROUPS,
+	WARN_LAYOUT,
+	NUM_GAME_WARNINGS,
+};
+
 struct game_t {
-	string name;
-	string namespace_;
+	string_view name;
+	string_view namespace_;
 	vector<section_t> sections;
-	vector<pair<string, rapidjson::Value>> groups;
+	vector<group_t> groups;
+	game_layout_t layout;
 
-	static map<string, loc_str_t> glossary;
+	size_t index{ 0 };
+	// Warnings from reading the game, and from finalize_game()
+	string warnings[NUM_GAME_WARNINGS];
 
 	game_t() = default;
 };
 
-map<string, loc_str_t> game_t::glossary;
+// Bump allocator for the strings of the model that can't point into the
+// JSON. Strings are never freed one by one, the whole arena goes with the
+// generation.
+struct string_arena_t {
+	static constexpr size_t CHUNK_SIZE = 1 << 20;
+
+	vector<std::unique_ptr<char[]>> chunks;
+	char* next{ nullptr };
+	size_t left{ 0 };
+
+	// Copies the string with a NUL after it
+	string_view copy(const char* str, size_t length) {
+		if (left < length + 1) {
+			left = std::max(CHUNK_SIZE, length + 1);
+			chunks.emplace_back(new char[left]);
+			next = chunks.back().get();
+		}
+		memcpy(next, str, length);
+		next[length] = '\0';
+		string_view view(next, length);
+		next += length + 1;
+		left -= length + 1;
+		return view;
+	}
+	string_view copy(string_view str) {
+		return copy(str.data(), str.size());
+	}
+};
 
-bool ValidateGroup(rapidjson::GenericValue<rapidjson::UTF8<>>& value) {
-	if (!value.IsArray()) return true;
+// Every distinct string of the generated tables, numbered in the order
+// they're met: the glossary's, then each section's. The source file lists
+// each once in a constexpr th_str[] and the tables are initialized from
+// it, so the thprac binary stores it once however many difficulties,
+// languages and games share it, whether or not the compiler pools
+// literals. Optimizing builds only read th_str[] at compile time and
+// drop it, unoptimized ones keep it as one more table of pointers.
+struct string_pool_t {
+	vector<string_view> strings;
+	// With the string blob, every string as the compiler would store its
+	// literal, NUL terminated and back to back, and where each one starts
+	string blob;
+	vector<uint32_t> offsets;
+
+	// "" is always entry 0, every table starts with it
+	string_pool_t() {
+		strings.push_back("");
+		slots.resize(1 << 12);
+	}
 
-	for (auto& sub_value : value.GetArray()) {
-		if (sub_value.IsArray() && ValidateGroup(sub_value)) return false;
-		else if (!sub_value.IsString()) return false;
+	uint32_t intern(string_view str) {
+		if (str.empty())
+			return 0;
+		auto hash = (uint32_t) std::hash<string_view>()(str);
+		size_t mask = slots.size() - 1;
+		for (size_t i = hash & mask;; i = (i + 1) & mask) {
+			auto& slot = slots[i];
+			if (!slot.id) {
+				slot = { hash, (uint32_t) strings.size() };
+				strings.push_back(str);
+				// Keep at most half the slots used
+				if (strings.size() * 2 > slots.size())
+					grow();
+				return (uint32_t) strings.size() - 1;
+			}
+			if (slot.hash == hash && strings[slot.id] == str)
+				return slot.id;
+		}
 	}
 
-	return true;
-}
+	void build_blob() {
+		blob.clear();
+		offsets.clear();
+		for (auto str : strings) {
+			offsets.push_back((uint32_t) blob.size());
+			append_literal_bytes(blob, str);
+			blob += '\0';
+		}
+	}
 
-void PrintGroupSize(std::string& output, rapidjson::Value& value) {
-	vector<rapidjson::SizeType> result;
-	function<void(rapidjson::Value&, unsigned int)> getSizeLimit = [&](
-		rapidjson::Value& value, unsigned int dim
-	) {
-		if (value.IsArray()) {
-			if (result.size() < dim + 1) result.resize(dim + 1);
-			for (auto it = value.Begin(); it != value.End(); ++it)
-				getSizeLimit(*it, dim + 1);
-			if (result[dim] < value.Size()) result[dim] = value.Size();
+	// Type of the offset tables, uint16_t while the blob is small enough
+	const char* offset_type() const {
+		return blob.size() <= 0x10000 ? "uint16_t" : "uint32_t";
+	}
+
+private:
+	// The bytes of the literal EscapeCString() makes of `str`. Only \0 is
+	// left as an escape, and it starts an octal one with up to two more
+	// digits.
+	static void append_literal_bytes(string& out, string_view str) {
+		for (size_t i = 0; i < str.size(); i++) {
+			if (str[i] != '\\' || i + 1 == str.size() || str[i + 1] != '0') {
+				out += str[i];
+				continue;
+			}
+			i++;
+			unsigned int value = 0;
+			for (int digits = 1; digits < 3; digits++) {
+				if (i + 1 == str.size() || str[i + 1] < '0' || str[i + 1] > '7')
+					break;
+				value = value * 8 + (str[++i] - '0');
+			}
+			out += (char) value;
 		}
+	}
+
+	// Open addressing, with a million lookups on big files std::unordered_map
+	// spent most of its time chasing nodes. Id 0 marks an empty slot, "" is
+	// never looked up.
+	struct slot_t {
+		uint32_t hash;
+		uint32_t id;
 	};
+	vector<slot_t> slots;
+
+	void grow() {
+		vector<slot_t> old(slots.size() * 2);
+		old.swap(slots);
+		size_t mask = slots.size() - 1;
+		for (auto& slot : old) {
+			if (!slot.id)
+				continue;
+			size_t i = slot.hash & mask;
+			while (slots[i].id)
+				i = (i + 1) & mask;
+			slots[i] = slot;
+		}
+	}
+};
 
-	getSizeLimit(value, 0);
-	if (result.size() > 0) result.back()++;
-	for (auto dim : result)
-		sprintf_append(output, "[%d]", dim);
+// Everything one generation reads and writes besides its games, so that
+// generations can run side by side and none sees the previous one's
+// glossary
+struct loc_json_ctx_t {
+	string_arena_t strings;
+	map<string_view, loc_str_t> glossary;
+	string_pool_t pool;
+	// Emit the strings as one blob with offset tables, see generate_loc_json()
+	bool string_blob = false;
+	string warnings;
+
+	const loc_str_t* find_glossary(string_view key) const;
+};
 
+const loc_str_t* loc_json_ctx_t::find_glossary(string_view key) const {
+	auto it = glossary.find(key);
+	return it != glossary.end() ? &it->second : nullptr;
 }
 
-void PrintGroup(std::string& output, rapidjson::Value& value, int tab = 0) {
-	if (value.IsArray()) {
-		for (int i = tab; i > 0; --i) output.push_back(' ');
-		sprintf_append(output, "{" ENDL);
-		for (auto v_itr = value.Begin(); v_itr != value.End(); ++v_itr)
-			PrintGroup(output, *v_itr, tab + 4);
-		for (int i = tab; i > 0; --i) output.push_back(' ');
-		sprintf_append(output, "}%c" ENDL, !tab ? ';' : ',');
-	} else {
-		for (int i = tab; i > 0; --i) output.push_back(' ');
-		if (!tab)
-			sprintf_append(output, "= %s;" ENDL, value.GetString());
-		else
-			sprintf_append(output, "%s," ENDL, value.GetString());
-	}
+vector<size_t> GetGroupShape(const group_t& group) {
+	if (!group.is_array)
+		return {};
+	return { group.items.size() + 1 };
 }
 
-std::string EscapeString(std::string& str) {
-	auto escaped_str = str;
-	auto length = escaped_str.length();
-
-	for (size_t i = 0; i < length; ++i) {
-		if (escaped_str[i] == '\"') {
-			escaped_str.insert(i, "\\");
-			i++;
-			length++;
-		} else if (escaped_str[i] == '\\') {
-			if (i + 1 != length && escaped_str[i + 1] != '0') {
-				escaped_str.insert(i, "\\");
-				i++;
-				length++;
-			}
-		} else if (escaped_str[i] == '\n') {
+void PrintGroupSize(TextWriter& out, const vector<size_t>& shape) {
+	for (auto dim : shape)
+		out << '[' << dim << ']';
+}
 
-			escaped_str.insert(i, "\\");
-			i++;
-			length++;
-			escaped_str[i] = 'n';
+void PrintGroup(TextWriter& out, const group_t& group) {
+	if (group.is_array) {
+		out << "{" ENDL;
+		for (auto& item : group.items) {
+			out.Spaces(4);
+			out << item << "," ENDL;
 		}
+		out << "};" ENDL;
+	} else {
+		out << "= " << group.items[0] << ";" ENDL;
 	}
-	return escaped_str;
 }
 
-bool section_t::FillWith(rapidjson::Value& sec) {
+void section_t::ApplySwitch(
+	const char* sw_key,
+	const switch_value_t& sw_value,
+	const loc_json_ctx_t& ctx,
+	string& warnings
+) {
 	enum sec_switch {
 		SW_BGM,
 		SW_APPEARANCE,
@@ -286,7 +467,7 @@ bool section_t::FillWith(rapidjson::Value& sec) {
 		SW_REF,
 	};
 
-	static unordered_map<string, sec_switch> sec_switch_map
+	static const unordered_map<string, sec_switch> sec_switch_map
 	{
 		{"bgm", SW_BGM},
 		{"appearance", SW_APPEARANCE},
@@ -294,508 +475,499 @@ bool section_t::FillWith(rapidjson::Value& sec) {
 		{"ref", SW_REF},
 	};
 
-	for (auto sw_itr = sec.MemberBegin(); sw_itr != sec.MemberEnd(); ++sw_itr) {
-		auto sw_key = sw_itr->name.GetString();
-		auto& sw_value = sw_itr->value;
-
-		if (sw_key[0] == '!') {
-			loc_str_t lstr;
-			if (
-				sw_value.IsArray() &&
-				sw_value.Size() == NUM_LANGUAGES &&
-				sw_value[0].IsString() &&
-				sw_value[1].IsString() &&
-				sw_value[2].IsString()
-			) {
-				lstr = {
-					sw_value[0].GetString(),
-					sw_value[1].GetString(),
-					sw_value[2].GetString()
-				};
-			} else if (sw_value.IsString()) {
-				auto it = game_t::glossary.find(sw_value.GetString());
-				SKIP_IF(
-					it == game_t::glossary.end(),
-					"Warning: Reference not found: %s, ignoring.",
-					sw_value.GetString()
-				);
-				lstr = it->second;
-			} else {
-				SKIP_IF(
-					true,
-					"Warning: Incorrect rank switch value: %s, ignoring.",
-					sw_key
-				);
-			}
-
-			for (size_t i = 1; i < strlen(sw_key); ++i) {
-				auto error = false;
-				switch (sw_key[i]) {
-					case 'E':
-						loc_str[DIFFICULTY_EASY] = lstr;
-						break;
-					case 'N':
-						loc_str[DIFFICULTY_NORMAL] = lstr;
-						break;
-					case 'H':
-						loc_str[DIFFICULTY_HARD] = lstr;
-						break;
-					case 'L':
-						loc_str[DIFFICULTY_LUNATIC] = lstr;
-						break;
-					case 'X':
-						for (auto difficulty : DIFFICULTY_LIST) {
-							loc_str[difficulty] = lstr;
-						}
-						break;
-					default:
-						error = true;
-						break;
-				}
-				BREAK_IF(
-					error,
-					"Warning: Incorrect rank switch: %s, ignoring.",
-					sw_key
+	if (sw_key[0] == '!') {
+		loc_str_t lstr;
+		if (sw_value.is_triple(json_scalar_t::STRING)) {
+			lstr = {
+				sw_value.items[0].str,
+				sw_value.items[1].str,
+				sw_value.items[2].str
+			};
+		} else if (sw_value.is_string()) {
+			auto def = ctx.find_glossary(sw_value.str);
+			if (!def) {
+				printf_warn(
+					warnings,
+					"Warning: Reference not found: %s, ignoring." ENDL,
+					sw_value.str.data()
 				);
+				return;
 			}
+			lstr = *def;
 		} else {
-			switch (sec_switch_map[sw_key]) {
-				case SW_BGM:
-					BREAK_IF(
-						!sw_value.IsInt(),
-						"Warning: Incorrect property switch: %s, ignoring.",
-						sw_key
-					);
-					bgm_id = sw_value.GetInt();
+			printf_warn(
+				warnings,
+				"Warning: Incorrect rank switch value: %s, ignoring." ENDL,
+				sw_key
+			);
+			return;
+		}
+
+		for (size_t i = 1; i < strlen(sw_key); ++i) {
+			auto error = false;
+			switch (sw_key[i]) {
+				case 'E':
+					loc_str[DIFFICULTY_EASY] = lstr;
 					break;
-				case SW_APPEARANCE:
-					BREAK_IF(
-						(
-							!sw_value.IsArray() ||
-							sw_value.Size() != NUM_LANGUAGES ||
-							!sw_value[0].IsInt() ||
-							!sw_value[1].IsInt() ||
-							!sw_value[2].IsInt()
-						),
-						"Warning: Incorrect property switch: %s, ignoring.",
-						sw_key
-					);
-					appearance[0] = sw_value[0].GetInt();
-					appearance[1] = sw_value[1].GetInt();
-					appearance[2] = sw_value[2].GetInt();
+				case 'N':
+					loc_str[DIFFICULTY_NORMAL] = lstr;
 					break;
-				case SW_SPELL:
-					BREAK_IF(
-						!sw_value.IsInt(),
-						"Warning: Incorrect property switch: %s, ignoring.",
-						sw_key
-					);
-					spell_id = sw_value.GetInt();
+				case 'H':
+					loc_str[DIFFICULTY_HARD] = lstr;
 					break;
-				case SW_REF:
-					BREAK_IF(
-						!sw_value.IsString(),
-						"Warning: Incorrect property switch: %s, ignoring.",
-						sw_key
-					);
-					ref = sw_value.GetString();
+				case 'L':
+					loc_str[DIFFICULTY_LUNATIC] = lstr;
+					break;
+				case 'X':
+					for (auto difficulty : DIFFICULTY_LIST) {
+						loc_str[difficulty] = lstr;
+					}
 					break;
 				default:
-					BREAK_IF(
-						true,
-						"Warning: Incorrect property switch: %s, ignoring.",
-						sw_key
-					);
+					error = true;
 					break;
 			}
+			BREAK_IF(
+				error,
+				warnings,
+				"Warning: Incorrect rank switch: %s, ignoring.",
+				sw_key
+			);
+		}
+	} else {
+		// Unknown switches read as SW_BGM, like operator[] used to give
+		// them. find() doesn't insert, so sections can be read on
+		// several threads.
+		auto switch_itr = sec_switch_map.find(sw_key);
+		switch (switch_itr != sec_switch_map.end() ? switch_itr->second : SW_BGM) {
+			case SW_BGM:
+				BREAK_IF(
+					!sw_value.is_int(),
+					warnings,
+					"Warning: Incorrect property switch: %s, ignoring.",
+					sw_key
+				);
+				bgm_id = sw_value.int_value;
+				break;
+			case SW_APPEARANCE:
+				BREAK_IF(
+					!sw_value.is_triple(json_scalar_t::INT),
+					warnings,
+					"Warning: Incorrect property switch: %s, ignoring.",
+					sw_key
+				);
+				appearance[0] = sw_value.items[0].int_value;
+				appearance[1] = sw_value.items[1].int_value;
+				appearance[2] = sw_value.items[2].int_value;
+				break;
+			case SW_SPELL:
+				BREAK_IF(
+					!sw_value.is_int(),
+					warnings,
+					"Warning: Incorrect property switch: %s, ignoring.",
+					sw_key
+				);
+				spell_id = sw_value.int_value;
+				break;
+			case SW_REF:
+				BREAK_IF(
+					!sw_value.is_string(),
+					warnings,
+					"Warning: Incorrect property switch: %s, ignoring.",
+					sw_key
+				);
+				ref = sw_value.str;
+				break;
+			default:
+				BREAK_IF(
+					true,
+					warnings,
+					"Warning: Incorrect property switch: %s, ignoring.",
+					sw_key
+				);
+				break;
 		}
 	}
-
-	return true;
 }
 
-void write_autogenerated_warning(string& output) {
-	sprintf_append(
-		output,
+void write_autogenerated_warning(TextWriter& out) {
+	out <<
 		"// THIS FILE IS AUTOGENERATED" ENDL
-	);
-	sprintf_append(
-		output,
 		"// If you want to edit this file, edit thprac_games_def.json" ENDL
-	);
-	sprintf_append(
-		output,
 		"// Then, use the thprac devtools to regenerate this file" ENDL
-	);
-	sprintf_append(
-		output,
-		"// https://github.com/touhouworldcup/thprac_utils/" ENDL ENDL
-	);
+		"// https://github.com/touhouworldcup/thprac_utils/" ENDL ENDL;
 }
 
-void generate_header_file(string& output, vector<game_t>& games) {
-	// Header
-	write_autogenerated_warning(output);
-	sprintf_append(output, "#pragma once" ENDL);
-	sprintf_append(output, "#include <cstdint>" ENDL ENDL);
-	sprintf_append(output, "namespace THPrac {" ENDL ENDL);
-
-	// Glossary enum
-	if (game_t::glossary.size() < 256)
-		sprintf_append(
-			output,
-			"enum th_glossary_t : uint8_t" ENDL
-			"{" ENDL
-			"    A0000ERROR_C," ENDL
-		);
-	else
-		sprintf_append(
-			output,
-			"enum th_glossary_t" ENDL
-			"{" ENDL
-			"    A0000ERROR_C," ENDL
-		);
-	for (auto& glossary_entry : game_t::glossary)
-		sprintf_append(output, "    %s," ENDL, glossary_entry.first.c_str());
-	sprintf_append(output, "};" ENDL ENDL);
-
-	// Glossary string declaration
-	sprintf_append(
-		output,
-		"extern const char* th_glossary_str[%d][%d];" ENDL ENDL,
-		NUM_LANGUAGES,
-		game_t::glossary.size() + 1
-	);
+// How each byte of the string blob is written out, as a character literal
+// where it's readable
+static const struct blob_char_spelling_t {
+	char text[256][8];
+
+	blob_char_spelling_t() {
+		for (int c = 0; c < 256; c++) {
+			const char* format =
+				c == 0 ? "0," :
+				c == '\'' || c == '\\' ? "'\\%c'," :
+				c >= 0x20 && c < 0x7f ? "'%c'," :
+				"'\\x%02x',";
+			snprintf(text[c], sizeof(text[c]), format, c);
+		}
+	}
 
-	// Per-"game" output
-	// (NOTE: Not every entry is actually a game. However, every actual game
-	// will have a non-empty namespace string.)
-	for (auto& game : games) {
-		bool has_namespace = game.namespace_.length() > 0;
-		if (has_namespace) {
-			// Namespace start
-			sprintf_append(
-				output,
-				"namespace %s {" ENDL ENDL,
-				game.namespace_.c_str()
-			);
+	string_view operator[](uint8_t c) const {
+		return text[c];
+	}
+} blob_char_spelling;
+
+// Declares a string table with the string blob: the offsets, and the
+// accessor named like the array of const char* it replaces
+void print_str_table_declaration(
+	TextWriter& out,
+	const loc_json_ctx_t& ctx,
+	string_view name,
+	const string& outer_dims,
+	const string& inner_dims
+) {
+	auto offset_type = ctx.pool.offset_type();
+	out << "extern const " << offset_type << " " << name << "_offsets"
+		<< outer_dims << inner_dims << ";" ENDL;
+	out << "constexpr th_str_table_t<" << offset_type << inner_dims << "> "
+		<< name << "{ " << name << "_offsets };" ENDL ENDL;
+}
 
-			// Sections enum
-			if (game.sections.size() < 256)
-				sprintf_append(
-					output,
-					"enum th_sections_t : uint8_t" ENDL
-					"{" ENDL
-					"    A0000ERROR," ENDL
-				);
-			else
-				sprintf_append(
-					output,
-					"enum th_sections_t" ENDL
-					"{" ENDL
-					"    A0000ERROR," ENDL
-				);
-			for (auto& section : game.sections)
-				sprintf_append(output, "    %s," ENDL, section.name.c_str());
-			sprintf_append(output, "};" ENDL ENDL);
-
-			// Sections string array declaration
-			sprintf_append(
-				output,
-				"extern const char* th_sections_str[%d][%d][%d];" ENDL ENDL,
-				NUM_LANGUAGES,
-				MAX_NUM_DIFFICULTIES,
-				game.sections.size() + 1
-			);
+// Opens the definition of a string table, its pointers or its offsets
+void print_str_table_definition(
+	TextWriter& out,
+	const loc_json_ctx_t& ctx,
+	string_view name,
+	const string& outer_dims,
+	const string& inner_dims
+) {
+	if (ctx.string_blob) {
+		out << "const " << ctx.pool.offset_type() << " " << name
+			<< "_offsets";
+	} else {
+		out << "const char* " << name;
+	}
+	out << outer_dims << inner_dims << ENDL "{" ENDL;
+}
 
-			// Sections BGM id array declaration
-			sprintf_append(
-				output,
-				"extern const uint8_t th_sections_bgm[%d];" ENDL ENDL,
-				game.sections.size() + 1
-			);
+// A string table entry, a pool string or its offset in the blob
+void print_str_ref(TextWriter& out, const loc_json_ctx_t& ctx, uint32_t pool_id) {
+	if (ctx.string_blob)
+		out << ctx.pool.offsets[pool_id] << "," ENDL;
+	else
+		out << "th_str[" << pool_id << "]," ENDL;
+}
 
-			// Sections by appearance - get array sizes
-			int dimension_zero = 1;
-			int dimension_one = 1;
-			int dimension_two = 1;
-			for (auto& section : game.sections) {
-				if (section.appearance[0] > dimension_zero)
-					dimension_zero = section.appearance[0];
-				if (section.appearance[1] > dimension_one)
-					dimension_one = section.appearance[1];
-				if (section.appearance[2] > dimension_two)
-					dimension_two = section.appearance[2];
-			}
+void generate_header_start(TextWriter& out, loc_json_ctx_t& ctx) {
+	// Header
+	write_autogenerated_warning(out);
+	out << "#pragma once" ENDL;
+	if (ctx.string_blob)
+		out << "#include <cstddef>" ENDL;
+	out << "#include <cstdint>" ENDL ENDL;
+	out << "namespace THPrac {" ENDL ENDL;
 
-			// Sections by appearance - declaration
-			sprintf_append(
-				output,
-				"extern const th_sections_t th_sections_cba[%d][%d][%d];" ENDL
-				ENDL,
-				dimension_zero, dimension_one, dimension_two + 1
-			);
+	// Glossary enum
+	if (ctx.glossary.size() < 256)
+		out << "enum th_glossary_t : uint8_t" ENDL;
+	else
+		out << "enum th_glossary_t" ENDL;
+	out << "{" ENDL "    A0000ERROR_C," ENDL;
+	for (auto& glossary_entry : ctx.glossary)
+		out << "    " << glossary_entry.first << "," ENDL;
+	out << "};" ENDL ENDL;
+
+	if (!ctx.string_blob) {
+		// Glossary string declaration
+		out << "extern const char* th_glossary_str[" << NUM_LANGUAGES << "]["
+			<< ctx.glossary.size() + 1 << "];" ENDL ENDL;
+		return;
+	}
 
-			// Sections by type - get array sizes
-			// NOTE: This also builds a "cbt" array, which is only used here to
-			// calculate the size of the declared array.
-			// TODO: Remove the "cbt" vector, as it shouldn't be necessary here.
-			constexpr size_t CBT_DIMENSION_ONE = 2;
-			size_t cbt_dimension_two = 0;
-			vector<vector<vector<string>>> cbt;
-			cbt.resize(dimension_zero);
-			for (auto& i1 : cbt)
-				i1.resize(CBT_DIMENSION_ONE);
-			for (auto& section : game.sections) {
-				// TODO: Figure out what this index is actually doing.
-				size_t unknown_index = section.spell_id ? 1 : 0;
-				cbt[section.appearance[0] - 1][unknown_index].emplace_back(
-					section.name
-				);
-				auto sss = cbt[section.appearance[0] - 1][unknown_index].size();
-				if (sss > cbt_dimension_two) cbt_dimension_two = sss;
-			}
+	// String blob declaration, and the accessor that indexes an offset
+	// table like the array of const char* it stands in for
+	out << "extern const char th_str_blob[" << ctx.pool.blob.size() << "];" ENDL ENDL;
+	out <<
+		"template <typename T>" ENDL
+		"struct th_str_table_t" ENDL
+		"{" ENDL
+		"    const T* offsets;" ENDL
+		"    const char* operator[](size_t i) const { return th_str_blob + offsets[i]; }" ENDL
+		"};" ENDL ENDL
+		"template <typename T, size_t N>" ENDL
+		"struct th_str_table_t<T[N]>" ENDL
+		"{" ENDL
+		"    const T (*offsets)[N];" ENDL
+		"    constexpr th_str_table_t<T> operator[](size_t i) const { return { offsets[i] }; }" ENDL
+		"};" ENDL ENDL;
+
+	// Glossary offsets declaration
+	print_str_table_declaration(
+		out,
+		ctx,
+		"th_glossary_str",
+		"[" + std::to_string(NUM_LANGUAGES) + "]",
+		"[" + std::to_string(ctx.glossary.size() + 1) + "]"
+	);
+}
 
-			// Sections by type - declaration
-			sprintf_append(
-				output,
-				"extern const th_sections_t th_sections_cbt[%d][%d][%d];" ENDL
-				ENDL,
-				dimension_zero, CBT_DIMENSION_ONE, cbt_dimension_two + 1
+// One game's part of the header file. Games only depend on the glossary,
+// so their parts can be generated on any thread and joined in order.
+// (NOTE: Not every entry is actually a game. However, every actual game
+// will have a non-empty namespace string.)
+void generate_header_game(
+	TextWriter& out,
+	const loc_json_ctx_t& ctx,
+	game_t& game
+) {
+	bool has_namespace = game.namespace_.length() > 0;
+	if (has_namespace) {
+		// Namespace start
+		out << "namespace " << game.namespace_ << " {" ENDL ENDL;
+
+		// Sections enum
+		if (game.sections.size() < 256)
+			out << "enum th_sections_t : uint8_t" ENDL;
+		else
+			out << "enum th_sections_t" ENDL;
+		out << "{" ENDL "    A0000ERROR," ENDL;
+		for (auto& section : game.sections)
+			out << "    " << section.name << "," ENDL;
+		out << "};" ENDL ENDL;
+
+		// Sections string array declaration
+		if (ctx.string_blob) {
+			print_str_table_declaration(
+				out,
+				ctx,
+				"th_sections_str",
+				"[" + std::to_string(NUM_LANGUAGES) + "]",
+				"[" + std::to_string(MAX_NUM_DIFFICULTIES) + "]["
+					+ std::to_string(game.sections.size() + 1) + "]"
 			);
+		} else {
+			out << "extern const char* th_sections_str[" << NUM_LANGUAGES << "]["
+				<< MAX_NUM_DIFFICULTIES << "][" << game.sections.size() + 1
+				<< "];" ENDL ENDL;
 		}
 
-		// Groups array declarations
-		for (auto& group : game.groups) {
-			sprintf_append(
-				output,
-				"extern const th_glossary_t %s",
-				group.first.c_str()
-			);
-			PrintGroupSize(output, group.second);
-			sprintf_append(output, ";" ENDL ENDL);
-		}
+		// Sections BGM id array declaration
+		out << "extern const uint8_t th_sections_bgm["
+			<< game.sections.size() + 1 << "];" ENDL ENDL;
 
+		auto& layout = game.layout;
 
-		// Namespace end
-		if (has_namespace) sprintf_append(output, "}" ENDL ENDL);
+		// Sections by appearance - declaration
+		out << "extern const th_sections_t th_sections_cba["
+			<< layout.cba_dims[0] << "][" << layout.cba_dims[1] << "]["
+			<< layout.cba_dims[2] + 1 << "];" ENDL ENDL;
 
+		// Sections by type - declaration
+		out << "extern const th_sections_t th_sections_cbt["
+			<< layout.cba_dims[0] << "][" << CBT_DIMENSION_ONE << "]["
+			<< layout.cbt_dimension_two + 1 << "];" ENDL ENDL;
 	}
 
+	// Groups array declarations
+	for (auto& group : game.groups) {
+		out << "extern const th_glossary_t " << group.name;
+		PrintGroupSize(out, game.layout.group_shapes[&group - game.groups.data()]);
+		out << ";" ENDL ENDL;
+	}
+
+
+	// Namespace end
+	if (has_namespace) out << "}" ENDL ENDL;
+}
+
+void generate_file_end(TextWriter& out) {
 	// `namespace THPrac` end
-	sprintf_append(output, "}" ENDL);
-	return;
+	out << "}" ENDL;
+}
+
+void generate_header_file(
+	TextWriter& out,
+	loc_json_ctx_t& ctx,
+	vector<game_t>& games
+) {
+	generate_header_start(out, ctx);
+	for (auto& game : games)
+		generate_header_game(out, ctx, game);
+	generate_file_end(out);
 }
 
-void generate_source_file(string& output, vector<game_t>& games) {
+void generate_source_start(TextWriter& out, loc_json_ctx_t& ctx) {
 	// Header
-	write_autogenerated_warning(output);
-	sprintf_append(output, "#include \"thprac_locale_def.h\"" ENDL ENDL);
-	sprintf_append(output, "namespace THPrac {" ENDL ENDL);
+	write_autogenerated_warning(out);
+	out << "#include \"thprac_locale_def.h\"" ENDL ENDL;
+	out << "namespace THPrac {" ENDL ENDL;
+
+	if (ctx.string_blob) {
+		// String blob, a line of characters per pooled string
+		out << "const char th_str_blob[" << ctx.pool.blob.size() << "]" ENDL "{" ENDL;
+		auto& blob = ctx.pool.blob;
+		auto& offsets = ctx.pool.offsets;
+		for (size_t i = 0; i < offsets.size(); i++) {
+			size_t end = i + 1 < offsets.size() ? offsets[i + 1] : blob.size();
+			out << "    ";
+			for (size_t j = offsets[i]; j < end; j++)
+				out << blob_char_spelling[(uint8_t) blob[j]];
+			out << ENDL;
+		}
+		out << "};" ENDL ENDL;
+	} else {
+		// String pool, see string_pool_t
+		out << "static constexpr const char* th_str[" << ctx.pool.strings.size()
+			<< "]" ENDL "{" ENDL;
+		for (auto str : ctx.pool.strings) {
+			out << "    \"";
+			out.Escaped(str);
+			out << "\"," ENDL;
+		}
+		out << "};" ENDL ENDL;
+	}
 
 	// Glossary string definition
-	sprintf_append(
-		output,
-		"const char* th_glossary_str[%d][%d]" ENDL
-		"{" ENDL,
-		NUM_LANGUAGES,
-		game_t::glossary.size() + 1
+	print_str_table_definition(
+		out,
+		ctx,
+		"th_glossary_str",
+		"[" + std::to_string(NUM_LANGUAGES) + "]",
+		"[" + std::to_string(ctx.glossary.size() + 1) + "]"
 	);
 	for (auto language : LANGUAGE_LIST) {
-		sprintf_append(output, "    {" ENDL "        \"\"," ENDL);
-		for (auto& glossary_entry : game_t::glossary)
-			sprintf_append(
-				output,
-				"        \"%s\"," ENDL,
-				EscapeString(
-					glossary_entry.second.get_language(language)
-				).c_str()
-			);
-		sprintf_append(output, "    }," ENDL);
+		out << "    {" ENDL "        ";
+		print_str_ref(out, ctx, 0);
+		for (auto& glossary_entry : ctx.glossary) {
+			out << "        ";
+			print_str_ref(out, ctx, glossary_entry.second.pool_id[(size_t) language]);
+		}
+		out << "    }," ENDL;
 	}
-	sprintf_append(output, "};" ENDL ENDL);
-
-	// Per-"game" output
-	// (NOTE: Not every entry is actually a game. However, every actual game
-	// will have a non-empty namespace string.)
-	for (auto& game : games) {
-		bool has_namespace = game.namespace_.length() > 0;
-		if (has_namespace) {
-			// Namespace start
-			sprintf_append(
-				output,
-				"namespace %s {" ENDL ENDL,
-				game.namespace_.c_str()
-			);
+	out << "};" ENDL ENDL;
+}
 
-			// Sections string array definition
-			sprintf_append(
-				output,
-				"const char* th_sections_str[%d][%d][%d]" ENDL
-				"{" ENDL,
-				NUM_LANGUAGES,
-				MAX_NUM_DIFFICULTIES,
-				game.sections.size() + 1
-			);
-			for (auto language : LANGUAGE_LIST) {
-				sprintf_append(output, "    {" ENDL);
-				for (auto difficulty : DIFFICULTY_LIST) {
-					sprintf_append(
-						output,
-						"        {" ENDL
-						"            \"\"," ENDL
+// One game's part of the source file, see generate_header_game()
+void generate_source_game(
+	TextWriter& out,
+	const loc_json_ctx_t& ctx,
+	game_t& game
+) {
+	bool has_namespace = game.namespace_.length() > 0;
+	if (has_namespace) {
+		// Namespace start
+		out << "namespace " << game.namespace_ << " {" ENDL ENDL;
+
+		// Sections string array definition
+		print_str_table_definition(
+			out,
+			ctx,
+			"th_sections_str",
+			"[" + std::to_string(NUM_LANGUAGES) + "]",
+			"[" + std::to_string(MAX_NUM_DIFFICULTIES) + "]["
+				+ std::to_string(game.sections.size() + 1) + "]"
+		);
+		for (auto language : LANGUAGE_LIST) {
+			out << "    {" ENDL;
+			for (auto difficulty : DIFFICULTY_LIST) {
+				out << "        {" ENDL "            ";
+				print_str_ref(out, ctx, 0);
+				for (auto& section : game.sections) {
+					out << "            ";
+					print_str_ref(
+						out,
+						ctx,
+						section.loc_str[difficulty].pool_id[(size_t) language]
 					);
-					for (auto& section : game.sections) {
-						string escaped_str = EscapeString(
-							section.loc_str[difficulty].get_language(language)
-						);
-						sprintf_append(
-							output,
-							"            \"%s\"," ENDL,
-							escaped_str.c_str()
-						);
-					}
-					sprintf_append(output, "        }," ENDL);
 				}
-				sprintf_append(output, "    }," ENDL);
-			}
-			sprintf_append(output, "};" ENDL ENDL);
-
-			// Sections BGM id array definition
-			sprintf_append(
-				output,
-				"const uint8_t th_sections_bgm[%d]" ENDL
-				"{" ENDL
-				"    0," ENDL,
-				game.sections.size() + 1
-			);
-			for (auto& section : game.sections)
-				sprintf_append(output, "    %d," ENDL, section.bgm_id);
-			sprintf_append(output, "};" ENDL ENDL);
-
-			// Sections by appearance - get array sizes
-			int dimension_zero = 1;
-			int dimension_one = 1;
-			int dimension_two = 1;
-			for (auto& section : game.sections) {
-				if (section.appearance[0] > dimension_zero)
-					dimension_zero = section.appearance[0];
-				if (section.appearance[1] > dimension_one)
-					dimension_one = section.appearance[1];
-				if (section.appearance[2] > dimension_two)
-					dimension_two = section.appearance[2];
-			}
-
-			// Sections by appearance - definition
-			vector<vector<vector<string>>> cba; // TODO: Find a better name.
-			cba.resize(dimension_zero);
-			for (auto& item1 : cba) {
-				item1.resize(dimension_one);
-				for (auto& item2 : item1)
-					item2.resize(dimension_two);
+				out << "        }," ENDL;
 			}
-			for (auto& section : game.sections) {
-				// NOTE: This code is indexing into three arrays.
-				// TODO: It's also disgusting. Find a better way to do this.
-				cba
-					[section.appearance[0] - 1]
-					[section.appearance[1] - 1]
-					[section.appearance[2] - 1]
-				= section.name;
-			}
-			// TODO: Since the "A0000ERROR" is never printed, is adding 1
-			// to dimension_two correct?
-			sprintf_append(
-				output,
-				"const th_sections_t th_sections_cba[%d][%d][%d]" ENDL
-				"{" ENDL,
-				dimension_zero, dimension_one, dimension_two + 1
-			);
-			// TODO: i1, i2, and i3 are terrible names. Plus, this nested loop
-			// is terrible. Find a better way to do this. (Maybe a recursive
-			// helper function?)
-			for (auto& i1 : cba) {
-				sprintf_append(output, "    {" ENDL);
-				for (auto& i2 : i1) {
-					sprintf_append(output, "        { ");
-					for (auto& i3 : i2) {
-						if (i3 == "") {
-							// TODO: Why is this commented out? (See also the
-							// TODO about adding 1 to dimension_two, above.)
-							// sprintf_append(output, "A0000ERROR, ");
-							break;
-						} else
-							sprintf_append(output, "%s, ", i3.c_str());
-					}
-					sprintf_append(output, "}," ENDL);
+			out << "    }," ENDL;
+		}
+		out << "};" ENDL ENDL;
+
+		// Sections BGM id array definition
+		out << "const uint8_t th_sections_bgm[" << game.sections.size() + 1
+			<< "]" ENDL "{" ENDL "    0," ENDL;
+		for (auto& section : game.sections)
+			out << "    " << section.bgm_id << "," ENDL;
+		out << "};" ENDL ENDL;
+
+		auto& layout = game.layout;
+
+		// Sections by appearance - definition
+		// TODO: Since the "A0000ERROR" is never printed, is adding 1
+		// to dimension_two correct?
+		out << "const th_sections_t th_sections_cba[" << layout.cba_dims[0]
+			<< "][" << layout.cba_dims[1] << "][" << layout.cba_dims[2] + 1
+			<< "]" ENDL "{" ENDL;
+		for (int i0 = 0; i0 < layout.cba_dims[0]; i0++) {
+			out << "    {" ENDL;
+			for (int i1 = 0; i1 < layout.cba_dims[1]; i1++) {
+				out << "        { ";
+				for (int i2 = 0; i2 < layout.cba_dims[2]; i2++) {
+					int section = layout.cba_at(i0, i1, i2);
+					// TODO: Why isn't A0000ERROR printed for the empty
+					// slots? (See also the TODO about adding 1 to
+					// dimension_two, above.)
+					if (section < 0)
+						break;
+					out << game.sections[section].name << ", ";
 				}
-				sprintf_append(output, "    }," ENDL);
-			}
-			sprintf_append(output, "};" ENDL ENDL);
-
-			// Sections by type - get array sizes (and build "cbt" array)
-			constexpr size_t CBT_DIMENSION_ONE = 2;
-			size_t cbt_dimension_two = 0;
-			vector<vector<vector<string>>> cbt; // TODO: Find a better name.
-			cbt.resize(dimension_zero);
-			for (auto& i1 : cbt)
-				i1.resize(CBT_DIMENSION_ONE);
-			for (auto& section : game.sections) {
-				// TODO: Figure out what this index is actually doing.
-				size_t unknown_index = section.spell_id ? 1 : 0;
-				cbt[section.appearance[0] - 1][unknown_index].emplace_back(
-					section.name
-				);
-				auto sss = cbt[section.appearance[0] - 1][unknown_index].size();
-				if (sss > cbt_dimension_two) cbt_dimension_two = sss;
+				out << "}," ENDL;
 			}
-
-			// Sections by type - definition
-			sprintf_append(
-				output,
-				"const th_sections_t th_sections_cbt[%d][%d][%d]" ENDL
-				"{" ENDL,
-				dimension_zero, CBT_DIMENSION_ONE, cbt_dimension_two + 1
-			);
-			for (auto& i1 : cbt) {
-				sprintf_append(output, "    {" ENDL);
-				for (auto& i2 : i1) {
-					sprintf_append(output, "        { ");
-					for (auto& i3 : i2) {
-						if (i3 == "")
-							sprintf_append(output, "A0000ERROR, ");
-						else
-							sprintf_append(output, "%s, ", i3.c_str());
-					}
-					sprintf_append(output, "}," ENDL);
+			out << "    }," ENDL;
+		}
+		out << "};" ENDL ENDL;
+
+		// Sections by type - definition
+		out << "const th_sections_t th_sections_cbt[" << layout.cba_dims[0]
+			<< "][" << CBT_DIMENSION_ONE << "][" << layout.cbt_dimension_two + 1
+			<< "]" ENDL "{" ENDL;
+		for (int i0 = 0; i0 < layout.cba_dims[0]; i0++) {
+			out << "    {" ENDL;
+			for (size_t i1 = 0; i1 < CBT_DIMENSION_ONE; i1++) {
+				out << "        { ";
+				size_t list = i0 * CBT_DIMENSION_ONE + i1;
+				for (size_t i = layout.cbt_start[list]; i < layout.cbt_start[list + 1]; i++) {
+					auto& name = game.sections[layout.cbt[i]].name;
+					if (name == "")
+						out << "A0000ERROR, ";
+					else
+						out << name << ", ";
 				}
-				sprintf_append(output, "    }," ENDL);
+				out << "}," ENDL;
 			}
-			sprintf_append(output, "};" ENDL ENDL);
-		}
-
-
-		// Groups array definitions
-		for (auto& group : game.groups) {
-			sprintf_append(
-				output,
-				"const th_glossary_t %s",
-				group.first.c_str()
-			);
-			PrintGroupSize(output, group.second);
-			sprintf_append(output, ENDL);
-			PrintGroup(output, group.second);
-			sprintf_append(output, ENDL);
+			out << "    }," ENDL;
 		}
+		out << "};" ENDL ENDL;
+	}
 
-		// Namespace end
-		if (has_namespace) sprintf_append(output, "}" ENDL ENDL);
 
+	// Groups array definitions
+	for (auto& group : game.groups) {
+		out << "const th_glossary_t " << group.name;
+		PrintGroupSize(out, game.layout.group_shapes[&group - game.groups.data()]);
+		out << ENDL;
+		PrintGroup(out, group);
+		out << ENDL;
 	}
 
-	// `namespace THPrac` end
-	sprintf_append(output, "}" ENDL);
-	return;
+	// Namespace end
+	if (has_namespace) out << "}" ENDL ENDL;
+}
+
+void generate_source_file(
+	TextWriter& out,
+	loc_json_ctx_t& ctx,
+	vector<game_t>& games
+) {
+	generate_source_start(out, ctx);
+	for (auto& game : games)
+		generate_source_game(out, ctx, game);
+	generate_file_end(out);
 }
 
 enum class CppFileType {
@@ -803,166 +975,862 @@ enum class CppFileType {
 	Source,
 };
 
-void loc_json(
-	rapidjson::Document& doc,
-	std::string& output,
-	CppFileType file_type
-) {
-
-	// Iterate through games
-	vector<game_t> games;
-	for (
-		auto game_itr = doc.MemberBegin();
-		game_itr != doc.MemberEnd();
-		++game_itr
+// Works out the game's layout from its sections and groups
+void finalize_game(game_t& game) {
+	auto& layout = game.layout;
+	layout = {};
+
+	// A section without a full appearance can't be placed in the tables
+	vector<int> placed;
+	for (size_t i = 0; i < game.sections.size(); i++) {
+		auto& section = game.sections[i];
+		if (
+			section.appearance[0] < 1 ||
+			section.appearance[1] < 1 ||
+			section.appearance[2] < 1
 		) {
-		games.emplace_back();
-		game_t& game_obj = games.back();
-		game_obj.name = game_itr->name.GetString();
-		g_current_game = game_itr->name.GetString();
-
-		auto& game = game_itr->value;
-		SKIP_IF(
-			!game.IsObject(),
-			"Warning: A non-object value for a game has detected, ignoring."
-		);
+			printf_warn(
+				game.warnings[WARN_LAYOUT],
+				"Warning: In game \"%s\": Section %s has no appearance, "
+				"leaving it out of the appearance tables." ENDL,
+				game.name.data(),
+				section.name.data()
+			);
+			continue;
+		}
+		placed.push_back((int) i);
+		for (size_t d = 0; d < 3; d++) {
+			if (section.appearance[d] > layout.cba_dims[d])
+				layout.cba_dims[d] = section.appearance[d];
+		}
+	}
 
-		// Check namespace
-		if (game.HasMember("namespace")) {
-			if (game["namespace"].IsString()) {
-				game_obj.namespace_ = game["namespace"].GetString();
-			} else {
-				printf_warn(
-					"Warning: In game \"%s\": "
-					"Invalid namespace value, ignoring." ENDL,
-					g_current_game.c_str()
-				);
-			}
+	// Sections by appearance. Later sections win a shared slot.
+	layout.cba.assign(
+		(size_t) layout.cba_dims[0] * layout.cba_dims[1] * layout.cba_dims[2],
+		-1
+	);
+	for (int i : placed) {
+		auto& section = game.sections[i];
+		layout.cba_at(
+			section.appearance[0] - 1,
+			section.appearance[1] - 1,
+			section.appearance[2] - 1
+		) = section.name.empty() ? -1 : i;
+	}
+
+	// Sections by type, counted first so every list is one run in `cbt`
+	// TODO: Figure out what the type index is actually doing.
+	size_t num_lists = layout.cba_dims[0] * CBT_DIMENSION_ONE;
+	layout.cbt_start.assign(num_lists + 1, 0);
+	auto list_of = [&](const section_t& section) {
+		return (section.appearance[0] - 1) * CBT_DIMENSION_ONE +
+			(section.spell_id ? 1 : 0);
+	};
+	for (int i : placed)
+		layout.cbt_start[list_of(game.sections[i]) + 1]++;
+	for (size_t list = 0; list < num_lists; list++) {
+		if (layout.cbt_start[list + 1] > layout.cbt_dimension_two)
+			layout.cbt_dimension_two = layout.cbt_start[list + 1];
+		layout.cbt_start[list + 1] += layout.cbt_start[list];
+	}
+	layout.cbt.resize(placed.size());
+	vector<size_t> fill(layout.cbt_start.begin(), layout.cbt_start.end() - 1);
+	for (int i : placed)
+		layout.cbt[fill[list_of(game.sections[i])]++] = i;
+
+	for (auto& group : game.groups)
+		layout.group_shapes.push_back(GetGroupShape(group));
+}
+
+// The JSON text as the reader sees it. Bounded, unlike rapidjson's in-situ
+// stream, so a mapped file doesn't need a NUL after it. Parsing in situ
+// decodes strings over the text they came from and ends them with a NUL;
+// otherwise the text is only read.
+struct loc_json_stream_t {
+	typedef char Ch;
+
+	char* head;
+	char* src;
+	char* end;
+	char* dst{ nullptr };
+
+	loc_json_stream_t(char* text, size_t size):
+		head(text), src(text), end(text + size)
+	{
+		// Skip a UTF-8 BOM the way rapidjson's EncodedInputStream does
+		for (unsigned char bom : { 0xEFu, 0xBBu, 0xBFu }) {
+			if (src != end && (unsigned char) *src == bom)
+				src++;
 		}
+	}
 
-		// Parsing Glossary
-		if (game.HasMember("glossary")) {
-			auto& glossary = game["glossary"];
-
-			if (glossary.IsObject()) {
-				for (
-					auto item_itr = glossary.MemberBegin();
-					item_itr != glossary.MemberEnd();
-					++item_itr
-					) {
-					auto& item = item_itr->value;
-					SKIP_IF(
-						(
-							!item.IsArray() ||
-							item.Size() != NUM_LANGUAGES ||
-							!item[0].IsString() ||
-							!item[1].IsString() ||
-							!item[2].IsString()
-							),
-						"Warning: In game \"%s\": Invalid glossary item: "
-						"\"%s\", ignoring.",
-						g_current_game.c_str(),
-						item_itr->name.GetString()
-					);
+	Ch Peek() const {
+		return src != end ? *src : '\0';
+	}
+	Ch Take() {
+		return src != end ? *src++ : '\0';
+	}
+	size_t Tell() const {
+		return src - head;
+	}
 
-					auto glossary_key = item_itr->name.GetString();
-					game_obj.glossary[glossary_key] = {
-						item[0].GetString(),
-						item[1].GetString(),
-						item[2].GetString()
-					};
-				}
+	// Only used in situ
+	Ch* PutBegin() {
+		return dst = src;
+	}
+	void Put(Ch c) {
+		*dst++ = c;
+	}
+	size_t PutEnd(Ch* begin) {
+		return dst - begin;
+	}
+	void Flush() {}
+};
+
+namespace rapidjson {
+template <>
+struct StreamTraits<loc_json_stream_t> {
+	enum { copyOptimization = 1 };
+};
+}
+
+// Builds games straight from the reader's events, so no DOM of the whole
+// file is ever built. Each open container has a frame, and values are put
+// where the frame on top says. Containers nobody looks into are skipped.
+//
+// Sections look up the glossary as read so far. When a game's glossary
+// comes after its sections, the sections are read again from the game's
+// text once the game ends, so they see all of it.
+struct loc_json_reader_t :
+	rapidjson::BaseReaderHandler<rapidjson::UTF8<>, loc_json_reader_t>
+{
+	enum frame_t {
+		FRAME_ROOT,
+		FRAME_GAME,
+		FRAME_GLOSSARY,
+		FRAME_SECTIONS,
+		FRAME_SECTION,
+		FRAME_GROUPS,
+		FRAME_SWITCH_ARRAY,
+		FRAME_GROUP_ARRAY,
+		FRAME_SKIP,
+	};
+
+	// Members of a game that are looked at
+	enum field_t {
+		FIELD_IGNORED,
+		FIELD_NAMESPACE,
+		FIELD_GLOSSARY,
+		FIELD_SECTIONS,
+		FIELD_GROUPS,
+		NUM_FIELDS,
+	};
+
+	loc_json_ctx_t& ctx;
+	vector<game_t>& games;
+	// The JSON as it was before parsing, for reading games again
+	const char* json;
+	const loc_json_stream_t& stream;
+	// Whether the strings the reader passes stay where they are
+	bool insitu;
+	// Set when only the sections of this game are read again
+	game_t* replay;
+
+	vector<frame_t> frames;
+	game_t* game{ nullptr };
+	field_t field{ FIELD_IGNORED };
+	// Only the first of each member of a game counts
+	bool field_seen[NUM_FIELDS]{};
+	bool sections_before_glossary{ false };
+	// Offset of the current game's text in the stream
+	size_t game_start{ 0 };
+	// Name of the section or group whose value comes next
+	string_view key;
+	// The glossary item or section switch being read
+	string switch_key;
+	switch_value_t switch_value;
+	// Scalars are read into the same buffer every time
+	json_scalar_t read_scalar;
+	bool root_is_object{ false };
+
+	loc_json_reader_t(
+		loc_json_ctx_t& ctx,
+		vector<game_t>& games,
+		const char* json,
+		const loc_json_stream_t& stream,
+		bool insitu,
+		game_t* replay = nullptr
+	):
+		ctx(ctx),
+		games(games),
+		json(json),
+		stream(stream),
+		insitu(insitu),
+		replay(replay)
+	{}
+
+	// A string from the reader that may end up in the model. In situ it
+	// already has a place, otherwise it goes to the arena.
+	string_view Keep(const char* str, size_t length) {
+		if (insitu)
+			return string_view(str, length);
+		return ctx.strings.copy(str, length);
+	}
+
+	void warn(game_warnings_t kind, const char* format, const char* what) {
+		printf_warn(game->warnings[kind], format, game->name.data(), what);
+	}
+
+	// Any value. `scalar` is null for the start of an object or array.
+	bool Value(const json_scalar_t* scalar, bool is_object) {
+		bool is_array = !scalar && !is_object;
+		frame_t push = FRAME_SKIP;
+		if (frames.empty()) {
+			if (replay) {
+				game = replay;
+				for (auto& seen : field_seen)
+					seen = true;
+				field_seen[FIELD_SECTIONS] = false;
+				push = FRAME_GAME;
 			} else {
-				printf_warn(
-					"Warning: In game \"%s\": "
-					"Invalid glossary value, ignoring." ENDL,
-					g_current_game.c_str()
-				);
+				root_is_object = is_object;
+				if (is_object)
+					push = FRAME_ROOT;
+			}
+		} else {
+			switch (frames.back()) {
+				case FRAME_ROOT:
+					if (is_object) {
+						// '{' has been taken already
+						game_start = stream.Tell() - 1;
+						push = FRAME_GAME;
+					} else {
+						printf_warn(
+							game->warnings[WARN_GAME],
+							"Warning: A non-object value for a game has "
+							"detected, ignoring." ENDL
+						);
+					}
+					break;
+				case FRAME_GAME:
+					push = GameField(scalar, is_object);
+					break;
+				case FRAME_GLOSSARY:
+				case FRAME_SECTION:
+					push = SwitchValue(scalar, is_array);
+					break;
+				case FRAME_SWITCH_ARRAY:
+					if (++switch_value.array_size <= NUM_LANGUAGES) {
+						auto& item = switch_value.items[switch_value.array_size - 1];
+						if (scalar)
+							item = *scalar;
+						else
+							item.type = json_scalar_t::OTHER;
+					}
+					break;
+				case FRAME_SECTIONS:
+					if (is_object) {
+						game->sections.emplace_back();
+						game->sections.back().name = key;
+						push = FRAME_SECTION;
+					} else {
+						warn(
+							WARN_SECTIONS,
+							"Warning: In game \"%s\": Incorrect section: %s" ENDL,
+							key.data()
+						);
+					}
+					break;
+				case FRAME_GROUPS:
+					if (is_array || (scalar && scalar->type == json_scalar_t::STRING)) {
+						game->groups.emplace_back();
+						auto& group = game->groups.back();
+						group.name = key;
+						group.is_array = is_array;
+						if (scalar)
+							group.items.push_back(scalar->str);
+						else
+							push = FRAME_GROUP_ARRAY;
+					} else {
+						warn(
+							WARN_GROUPS,
+							"Warning: In game \"%s\": Incorrect group: %s" ENDL,
+							key.data()
+						);
+					}
+					break;
+				case FRAME_GROUP_ARRAY: {
+					auto& group = game->groups.back();
+					if (scalar && scalar->type == json_scalar_t::STRING)
+						group.items.push_back(scalar->str);
+					else
+						group.valid = false;
+					break;
+				}
+				case FRAME_SKIP:
+					break;
 			}
 		}
+		if (!scalar)
+			frames.push_back(push);
+		return true;
+	}
 
-		// Parsing sections
-		if (game.HasMember("sections")) {
-			auto& sections = game["sections"];
-
-			if (sections.IsObject()) {
-				// Iterate through sections
-				for (
-					auto section_itr = sections.MemberBegin();
-					section_itr != sections.MemberEnd();
-					++section_itr
-					) {
-					SKIP_IF(
-						!section_itr->value.IsObject(),
-						"Warning: In game \"%s\": Incorrect section: %s",
-						g_current_game.c_str(),
-						section_itr->name.GetString()
+	frame_t GameField(const json_scalar_t* scalar, bool is_object) {
+		switch (field) {
+			case FIELD_NAMESPACE:
+				if (scalar && scalar->type == json_scalar_t::STRING) {
+					game->namespace_ = scalar->str;
+				} else {
+					warn(
+						WARN_NAMESPACE,
+						"Warning: In game \"%s\": "
+						"Invalid namespace value, ignoring." ENDL,
+						nullptr
 					);
-					game_obj.sections.emplace_back(
-						section_itr->name.GetString(),
-						section_itr->value
+				}
+				return FRAME_SKIP;
+			case FIELD_GLOSSARY:
+				if (!is_object) {
+					warn(
+						WARN_GLOSSARY,
+						"Warning: In game \"%s\": "
+						"Invalid glossary value, ignoring." ENDL,
+						nullptr
 					);
+					return FRAME_SKIP;
 				}
-			} else {
-				printf_warn(
-					"Warning: In game \"%s\": "
-					"Invalid sections value, ignoring." ENDL,
-					g_current_game.c_str()
-				);
-			}
+				sections_before_glossary = field_seen[FIELD_SECTIONS];
+				return FRAME_GLOSSARY;
+			case FIELD_SECTIONS:
+				if (!is_object) {
+					warn(
+						WARN_SECTIONS,
+						"Warning: In game \"%s\": "
+						"Invalid sections value, ignoring." ENDL,
+						nullptr
+					);
+					return FRAME_SKIP;
+				}
+				return FRAME_SECTIONS;
+			case FIELD_GROUPS:
+				if (!is_object) {
+					warn(
+						WARN_GROUPS,
+						"Warning: In game \"%s\": "
+						"Invalid groups value, ignoring." ENDL,
+						nullptr
+					);
+					return FRAME_SKIP;
+				}
+				return FRAME_GROUPS;
+			default:
+				return FRAME_SKIP;
+		}
+	}
+
+	// The value of a glossary item or a switch. Arrays are applied once
+	// they end, anything else right away.
+	frame_t SwitchValue(const json_scalar_t* scalar, bool is_array) {
+		if (is_array) {
+			switch_value.is_array = true;
+			return FRAME_SWITCH_ARRAY;
 		}
+		if (scalar)
+			static_cast<json_scalar_t&>(switch_value) = *scalar;
+		SwitchDone();
+		return FRAME_SKIP;
+	}
 
-		// Parsing groups
-		if (game.HasMember("groups")) {
-			auto& groups = game["groups"];
-
-			if (groups.IsObject()) {
-				// Iterate through sections
-				for (
-					auto group_itr = groups.MemberBegin();
-					group_itr != groups.MemberEnd();
-					++group_itr
-					) {
-					// Validate group
-					if (ValidateGroup(group_itr->value)) {
-						game_obj.groups.emplace_back();
-						game_obj.groups.back().first =
-							group_itr->name.GetString();
-						game_obj.groups.back().second = group_itr->value;
-					} else {
-						SKIP_IF(
-							true,
-							"Warning: In game \"%s\": Incorrect group: %s",
-							g_current_game.c_str(),
-							group_itr->name.GetString()
-						);
+	void SwitchDone() {
+		if (frames.back() == FRAME_SECTION) {
+			game->sections.back().ApplySwitch(
+				switch_key.c_str(),
+				switch_value,
+				ctx,
+				game->warnings[WARN_SECTIONS]
+			);
+			return;
+		}
+
+		if (!switch_value.is_triple(json_scalar_t::STRING)) {
+			warn(
+				WARN_GLOSSARY,
+				"Warning: In game \"%s\": Invalid glossary item: "
+				"\"%s\", ignoring." ENDL,
+				switch_key.c_str()
+			);
+			return;
+		}
+		loc_str_t loc_str = {
+			switch_value.items[0].str,
+			switch_value.items[1].str,
+			switch_value.items[2].str
+		};
+		auto it = ctx.glossary.find(switch_key);
+		if (it != ctx.glossary.end())
+			it->second = loc_str;
+		else
+			ctx.glossary.emplace(ctx.strings.copy(switch_key), loc_str);
+	}
+
+	// Reads the current game's sections again, now that its glossary is
+	// complete
+	bool ReadSectionsAgain() {
+		game->sections.clear();
+		game->warnings[WARN_SECTIONS].clear();
+		// Read from the text before parsing, which is only read from
+		loc_json_stream_t text(
+			const_cast<char*>(json) + game_start,
+			stream.Tell() - game_start
+		);
+		loc_json_reader_t handler(ctx, games, json, text, false, game);
+		rapidjson::Reader reader;
+		return !reader.Parse(text, handler).IsError();
+	}
+
+	bool Key(const char* str, rapidjson::SizeType, bool) {
+		switch (frames.back()) {
+			case FRAME_ROOT:
+				games.emplace_back();
+				game = &games.back();
+				game->name = Keep(str, strlen(str));
+				game->index = games.size() - 1;
+				for (auto& seen : field_seen)
+					seen = false;
+				sections_before_glossary = false;
+				break;
+			case FRAME_GAME: {
+				static const char* const field_names[NUM_FIELDS] = {
+					nullptr,
+					"namespace",
+					"glossary",
+					"sections",
+					"groups",
+				};
+				field = FIELD_IGNORED;
+				for (int i = FIELD_NAMESPACE; i < NUM_FIELDS; i++) {
+					if (!field_seen[i] && !strcmp(str, field_names[i])) {
+						field_seen[i] = true;
+						field = (field_t) i;
+						break;
 					}
 				}
-			} else {
-				printf_warn(
-					"Warning: In game \"%s\": "
-					"Invalid groups value, ignoring." ENDL,
-					g_current_game.c_str()
-				);
+				break;
+			}
+			case FRAME_GLOSSARY:
+			case FRAME_SECTION:
+				switch_key = str;
+				switch_value.type = json_scalar_t::OTHER;
+				switch_value.is_array = false;
+				switch_value.array_size = 0;
+				break;
+			case FRAME_SECTIONS:
+			case FRAME_GROUPS:
+				key = Keep(str, strlen(str));
+				break;
+			default:
+				break;
+		}
+		return true;
+	}
+
+	bool Null() {
+		read_scalar.type = json_scalar_t::OTHER;
+		return Value(&read_scalar, false);
+	}
+	bool Bool(bool) {
+		return Null();
+	}
+	bool Int(int i) {
+		read_scalar.type = json_scalar_t::INT;
+		read_scalar.int_value = i;
+		return Value(&read_scalar, false);
+	}
+	bool Uint(unsigned u) {
+		if (u > INT32_MAX)
+			return Null();
+		return Int((int) u);
+	}
+	// Out of int range, or not an integer
+	bool Int64(int64_t) {
+		return Null();
+	}
+	bool Uint64(uint64_t) {
+		return Null();
+	}
+	bool Double(double) {
+		return Null();
+	}
+	bool String(const char* str, rapidjson::SizeType length, bool) {
+		// An empty stack is a string root, which Value() rejects
+		if (!frames.empty() && frames.back() == FRAME_SKIP)
+			return true;
+		read_scalar.type = json_scalar_t::STRING;
+		// Group values were always printed whole, everything else stops
+		// at a \u0000
+		if (frames.empty() || (frames.back() != FRAME_GROUPS && frames.back() != FRAME_GROUP_ARRAY))
+			length = (rapidjson::SizeType) strlen(str);
+		read_scalar.str = Keep(str, length);
+		return Value(&read_scalar, false);
+	}
+	bool StartObject() {
+		return Value(nullptr, true);
+	}
+	bool EndObject(rapidjson::SizeType) {
+		frame_t frame = frames.back();
+		frames.pop_back();
+		if (frame == FRAME_GAME && sections_before_glossary)
+			return ReadSectionsAgain();
+		return true;
+	}
+	bool StartArray() {
+		return Value(nullptr, false);
+	}
+	bool EndArray(rapidjson::SizeType) {
+		frame_t frame = frames.back();
+		frames.pop_back();
+		if (frame == FRAME_SWITCH_ARRAY) {
+			SwitchDone();
+		} else if (frame == FRAME_GROUP_ARRAY && !game->groups.back().valid) {
+			warn(
+				WARN_GROUPS,
+				"Warning: In game \"%s\": Incorrect group: %s" ENDL,
+				game->groups.back().name.data()
+			);
+			game->groups.pop_back();
+		}
+		return true;
+	}
+};
+
+// Reads a thprac_games_def.json into games and the glossary. Errors go to
+// the warnings. With `insitu`, a writable copy of `json`, the JSON is parsed
+// in situ there and the model points into it, so it has to outlive the
+// games. Otherwise strings are copied to the arena.
+bool read_loc_json(
+	loc_json_ctx_t& ctx,
+	const char* json,
+	size_t json_size,
+	vector<game_t>& games,
+	char* insitu = nullptr
+) {
+	ctx.glossary.clear();
+	games.clear();
+	loc_json_stream_t stream(
+		insitu ? insitu : const_cast<char*>(json),
+		json_size
+	);
+	loc_json_reader_t handler(ctx, games, json, stream, insitu != nullptr);
+	rapidjson::Reader reader;
+	bool parsed = insitu ?
+		!reader.Parse<rapidjson::kParseInsituFlag>(stream, handler).IsError() :
+		!reader.Parse(stream, handler).IsError();
+	if (!parsed) {
+		printf_warn(
+			ctx.warnings,
+			"Error: Parse error: %d at %zu." ENDL,
+			reader.GetParseErrorCode(),
+			reader.GetErrorOffset()
+		);
+		games.clear();
+		return false;
+	}
+	if (!handler.root_is_object) {
+		printf_warn(ctx.warnings, "Error: The JSON root isn't an object." ENDL);
+		return false;
+	}
+	return true;
+}
+
+// Appends the warnings of all games in the order they used to be printed in
+// when games were built one after another: reading each game, then the
+// layouts
+void collect_game_warnings(loc_json_ctx_t& ctx, vector<game_t>& games) {
+	for (auto& game : games) {
+		for (int kind = WARN_GAME; kind < WARN_LAYOUT; kind++)
+			ctx.warnings += game.warnings[kind];
+	}
+	for (auto& game : games)
+		ctx.warnings += game.warnings[WARN_LAYOUT];
+}
+
+// Gives every string the source file's tables print its pool entry
+void intern_strings(loc_json_ctx_t& ctx, vector<game_t>& games) {
+	auto& pool = ctx.pool;
+	pool = {};
+	auto intern = [&](loc_str_t& loc_str) {
+		for (auto language : LANGUAGE_LIST) {
+			loc_str.pool_id[(size_t) language] =
+				pool.intern(loc_str.get_language(language));
+		}
+	};
+	for (auto& glossary_entry : ctx.glossary)
+		intern(glossary_entry.second);
+	for (auto& game : games) {
+		// Only games with a namespace have their sections printed
+		if (game.namespace_.empty())
+			continue;
+		for (auto& section : game.sections) {
+			for (auto difficulty : DIFFICULTY_LIST) {
+				auto& loc_str = section.loc_str[difficulty];
+				// Rank switches like !X put the same strings in several
+				// difficulties, which don't need looking up again
+				auto same = [&](const loc_str_t& other) {
+					return
+						loc_str.zh_str.data() == other.zh_str.data() &&
+						loc_str.en_str.data() == other.en_str.data() &&
+						loc_str.ja_str.data() == other.ja_str.data() &&
+						loc_str.zh_str.size() == other.zh_str.size() &&
+						loc_str.en_str.size() == other.en_str.size() &&
+						loc_str.ja_str.size() == other.ja_str.size();
+				};
+				if (difficulty && same(section.loc_str[difficulty - 1])) {
+					std::copy(
+						std::begin(section.loc_str[difficulty - 1].pool_id),
+						std::end(section.loc_str[difficulty - 1].pool_id),
+						loc_str.pool_id
+					);
+				} else {
+					intern(loc_str);
+				}
 			}
 		}
+	}
+	if (ctx.string_blob)
+		pool.build_blob();
+}
 
+// Works out the layout of every game read and pools the strings. Both
+// output files are generated from the same model, so it only has to be
+// built once.
+void build_games(loc_json_ctx_t& ctx, vector<game_t>& games) {
+	for (auto& game : games)
+		finalize_game(game);
+	intern_strings(ctx, games);
+	collect_game_warnings(ctx, games);
+}
+
+// Maps and reads the JSON file. Errors go to the warnings.
+bool parse_loc_json(
+	loc_json_ctx_t& ctx,
+	const char* filename,
+	vector<game_t>& games
+) {
+	MappedFile file(filename);
+	if (!file.fileMapView) {
+		printf_warn(ctx.warnings, "Error: Couldn't open %s." ENDL, filename);
+		return false;
 	}
+	return read_loc_json(
+		ctx,
+		(const char*) file.fileMapView,
+		file.fileSize,
+		games
+	);
+}
 
+void loc_json(
+	loc_json_ctx_t& ctx,
+	vector<game_t>& games,
+	std::string& output,
+	CppFileType file_type
+) {
+	build_games(ctx, games);
+	TextWriter out;
 	if (file_type == CppFileType::Header) {
-		generate_header_file(output, games);
+		generate_header_file(out, ctx, games);
 	} else {
-		generate_source_file(output, games);
+		generate_source_file(out, ctx, games);
+	}
+	output.assign(out.Data(), out.Size());
+}
+
+bool generate_loc_json(
+	const char* json,
+	size_t json_size,
+	std::string& header,
+	std::string& source,
+	std::string& warnings_out,
+	loc_json_times_t* times,
+	unsigned int num_threads,
+	char* insitu,
+	bool string_blob
+) {
+	using clock = std::chrono::steady_clock;
+	auto seconds_since = [](clock::time_point start) {
+		return std::chrono::duration<double>(clock::now() - start).count();
+	};
+	loc_json_times_t local_times;
+	if (!times)
+		times = &local_times;
+	*times = {};
+
+	loc_json_ctx_t ctx;
+	ctx.string_blob = string_blob;
+	auto start = clock::now();
+	vector<game_t> games;
+	if (!read_loc_json(ctx, json, json_size, games, insitu)) {
+		warnings_out = ctx.warnings;
+		return false;
+	}
+	times->parse = seconds_since(start);
+
+	TextWriter out;
+	if (num_threads == 1) {
+		start = clock::now();
+		build_games(ctx, games);
+		times->build = seconds_since(start);
+
+		start = clock::now();
+		generate_header_file(out, ctx, games);
+		header.assign(out.Data(), out.Size());
+		times->header = seconds_since(start);
+
+		start = clock::now();
+		out.Clear();
+		generate_source_file(out, ctx, games);
+		source.assign(out.Data(), out.Size());
+		times->source = seconds_since(start);
+
+		warnings_out = ctx.warnings;
+		return true;
+	}
+
+	// Each game is finalized and generated into its own buffers on
+	// whichever thread gets to it, then the buffers are joined in document
+	// order. The pool has to be complete before any game is printed.
+	start = clock::now();
+	intern_strings(ctx, games);
+	vector<TextWriter> game_headers, game_sources;
+	game_headers.reserve(games.size());
+	game_sources.reserve(games.size());
+	for (size_t i = 0; i < games.size(); i++) {
+		game_headers.emplace_back(4096);
+		game_sources.emplace_back(4096);
+	}
+	std::atomic<size_t> next_game{ 0 };
+	RunThreads(ThreadCount(num_threads, games.size()), [&](unsigned int) {
+		for (size_t i; (i = next_game.fetch_add(1)) < games.size();) {
+			finalize_game(games[i]);
+			generate_header_game(game_headers[i], ctx, games[i]);
+			generate_source_game(game_sources[i], ctx, games[i]);
+		}
+	});
+	collect_game_warnings(ctx, games);
+	times->build = seconds_since(start);
+
+	auto join = [&](
+		void (*generate_start)(TextWriter&, loc_json_ctx_t&),
+		vector<TextWriter>& parts,
+		std::string& file
+	) {
+		out.Clear();
+		generate_start(out, ctx);
+		size_t size = out.Size() + 2;
+		for (auto& part : parts)
+			size += part.Size();
+		file.clear();
+		file.reserve(size);
+		file.append(out.Data(), out.Size());
+		for (auto& part : parts)
+			file.append(part.Data(), part.Size());
+		out.Clear();
+		generate_file_end(out);
+		file.append(out.Data(), out.Size());
+	};
+	start = clock::now();
+	join(generate_header_start, game_headers, header);
+	times->header = seconds_since(start);
+
+	start = clock::now();
+	join(generate_source_start, game_sources, source);
+	times->source = seconds_since(start);
+
+	warnings_out = ctx.warnings;
+	return true;
+}
+
+static bool write_output_file(const char* filename, const string& text) {
+	FILE* out = OpenFileUtf8(filename, "wb");
+	if (!out) {
+		fprintf(stderr, "Error: Couldn't write %s\n", filename);
+		return false;
 	}
+	bool written = fwrite(text.data(), 1, text.size(), out) == text.size();
+	written &= fclose(out) == 0;
+	if (!written)
+		fprintf(stderr, "Error: Couldn't write %s\n", filename);
+	return written;
+}
 
-	return;
+// Headless version of the GUI, for build steps: one parse, one game model,
+// both files
+int loc_json_cli(int argc, char** argv) {
+	unsigned int num_threads = 0;
+	bool string_blob = false;
+	// Unknown options would otherwise shift the output paths
+	bool unknown_option = false;
+	vector<const char*> args;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-j") && i + 1 < argc)
+			num_threads = (unsigned int) strtoul(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "-b"))
+			string_blob = true;
+		else if (argv[i][0] == '-')
+			unknown_option = true;
+		else
+			args.push_back(argv[i]);
+	}
+	if (unknown_option || args.size() != 3) {
+		fprintf(
+			stderr,
+			"usage: loc-json [-j threads] [-b] <thprac_games_def.json> <header> <source>\n"
+			"  Generates thprac_locale_def.h and thprac_locale_def.cpp. Games are\n"
+			"  generated in parallel, -j 1 generates them one after another.\n"
+			"  -b emits the strings as one blob with offset tables, which need no\n"
+			"  relocations and stay in read-only pages.\n"
+		);
+		return 1;
+	}
+
+	MappedFile file(args[0]);
+	if (!file.fileMapView) {
+		fprintf(stderr, "Error: Couldn't open %s\n", args[0]);
+		return 1;
+	}
+	// A private copy-on-write view of the same file to parse in situ. The
+	// read-only view stays intact, in case a game has to be read again.
+	MappedFile scratch(args[0], true);
+	string header, source, warnings_text;
+	bool parsed = generate_loc_json(
+		(const char*) file.fileMapView,
+		file.fileSize,
+		header,
+		source,
+		warnings_text,
+		nullptr,
+		num_threads,
+		(char*) scratch.fileMapView,
+		string_blob
+	);
+	fputs(warnings_text.c_str(), stderr);
+	if (!parsed)
+		return 1;
+
+	if (!write_output_file(args[1], header) || !write_output_file(args[2], source))
+		return 1;
+	return 0;
 }
 
+#ifdef _WIN32
 #include <imgui.h>
 #include <imgui_stdlib.h>
 
 void loc_json_gui() {
 	static std::string output_file_text = "";
+	static std::string warnings_text = "";
 	static const char* input_filename = NULL;
 	if (ImGui::Button("Load input JSON")) {
 		if (auto temp = OpenFileDialog(L"JSON file (*.json)\0*.json\0")) {
@@ -978,59 +1846,34 @@ void loc_json_gui() {
 
 	// NOTE: Modified on button click (see below)
 	static CppFileType selected_file_type = CppFileType::Header;
+	static bool string_blob = false;
+	ImGui::Checkbox("Strings as one blob with offset tables", &string_blob);
 
-	if (ImGui::Button("Generate header file")) {
-		warnings = "";
+	if (ImGui::Button("Generate header file") && input_filename) {
 		output_file_text = "";
-		Document doc;
-		MappedFile file(utf8_to_utf16(input_filename).c_str());
-		if (file.fileMapView) {
-			if (
-				doc.Parse(
-					(char*) file.fileMapView,
-					file.fileSize
-				).HasParseError()
-			) {
-				printf_warn(
-					"Error: Parse error: %d at %d.",
-					doc.GetParseError(),
-					doc.GetErrorOffset()
-				);
-				goto after_generate;
-			}
-
+		loc_json_ctx_t ctx;
+		ctx.string_blob = string_blob;
+		vector<game_t> games;
+		if (parse_loc_json(ctx, input_filename, games)) {
 			selected_file_type = CppFileType::Header;
-			loc_json(doc, output_file_text, selected_file_type);
+			loc_json(ctx, games, output_file_text, selected_file_type);
 		}
+		warnings_text = ctx.warnings;
 	}
-	if (ImGui::Button("Generate source file")) {
-		warnings = "";
+	if (ImGui::Button("Generate source file") && input_filename) {
 		output_file_text = "";
-		Document doc;
-		MappedFile file(utf8_to_utf16(input_filename).c_str());
-		if (file.fileMapView) {
-			if (
-				doc.Parse(
-					(char*) file.fileMapView,
-					file.fileSize
-				).HasParseError()
-			) {
-				printf_warn(
-					"Error: Parse error: %d at %d.",
-					doc.GetParseError(),
-					doc.GetErrorOffset()
-				);
-				goto after_generate;
-			}
-
+		loc_json_ctx_t ctx;
+		ctx.string_blob = string_blob;
+		vector<game_t> games;
+		if (parse_loc_json(ctx, input_filename, games)) {
 			selected_file_type = CppFileType::Source;
-			loc_json(doc, output_file_text, selected_file_type);
+			loc_json(ctx, games, output_file_text, selected_file_type);
 		}
+		warnings_text = ctx.warnings;
 	}
-after_generate:
 	ImGui::NewLine();
-	if (warnings != "") {
-		ImGui::TextColored({ 1, 0, 0, 1 }, warnings.c_str());
+	if (warnings_text != "") {
+		ImGui::TextColored({ 1, 0, 0, 1 }, warnings_text.c_str());
 		ImGui::NewLine();
 	}
 
@@ -1097,3 +1940,4 @@ after_generate:
 	);
 	ImGui::EndChild();
 }
+#endif
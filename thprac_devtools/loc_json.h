@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Seconds spent in each step of generate_loc_json(). With several threads
+// `build` also covers generating each game, and `header` and `source` are
+// only the joining of the games' parts.
+struct loc_json_times_t {
+	double parse;
+	double build;
+	double header;
+	double source;
+};
+
+// Parses a thprac_games_def.json held in memory and generates
+// thprac_locale_def.h and .cpp from one game model. Warnings are put in
+// `warnings_out`. Returns false on a parse error.
+// Games are built and generated on `num_threads` threads, 0 = one per core.
+// The output doesn't depend on the thread count.
+// `insitu` is an optional writable copy of `json`, like a copy-on-write
+// mapping of the same file. The JSON is then parsed in situ there and the
+// model points into it, instead of into copies of every string. Its
+// contents are garbage afterwards.
+// With `string_blob` the string tables are offsets into one char blob
+// instead of arrays of pointers, so they need no base relocations and are
+// read-only. The header wraps them in th_str_table_t, which indexes like
+// the arrays did.
+bool generate_loc_json(
+	const char* json,
+	size_t json_size,
+	std::string& header,
+	std::string& source,
+	std::string& warnings_out,
+	loc_json_times_t* times = nullptr,
+	unsigned int num_threads = 1,
+	char* insitu = nullptr,
+	bool string_blob = false
+);
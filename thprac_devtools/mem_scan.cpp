@@ -0,0 +1,774 @@
+#include <ctype.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <remote_reader.h>
+#include <util.h>
+#include <parallel.h>
+#include <simd.h>
+#include "mem_scan.h"
+#include "mem_snapshot.h"
+
+// First scans read regions this many bytes at a time. Also the unit of work
+// handed to the threads, so one huge heap doesn't end up on one thread.
+constexpr size_t SCAN_CHUNK = 4 << 20;
+// Next scans read neighbouring candidates together if that doesn't waste
+// more than this many bytes in between
+constexpr size_t SCAN_SPAN_GAP = 4096;
+constexpr size_t SCAN_SPAN_MAX = 64 << 10;
+// Spans per RemoteReader::Flush()
+constexpr size_t SCAN_SPAN_BATCH = 256;
+
+static const struct {
+    const char* name;
+    ScanValueType type;
+    size_t size;
+} scan_value_types[] = {
+    { "i8", ScanValueType::Int8, 1 },
+    { "i16", ScanValueType::Int16, 2 },
+    { "i32", ScanValueType::Int32, 4 },
+    { "i64", ScanValueType::Int64, 8 },
+    { "float", ScanValueType::Float, 4 },
+    { "double", ScanValueType::Double, 8 },
+    { "bytes", ScanValueType::Bytes, 0 },
+};
+
+static const struct {
+    const char* name;
+    ScanFilter filter;
+} scan_filters[] = {
+    { "eq", ScanFilter::Equal },
+    { "changed", ScanFilter::Changed },
+    { "unchanged", ScanFilter::Unchanged },
+    { "inc", ScanFilter::Increased },
+    { "dec", ScanFilter::Decreased },
+};
+
+bool ParseScanValueType(const char* name, ScanValueType& typeOut)
+{
+    for (auto& it : scan_value_types) {
+        if (!strcmp(name, it.name)) {
+            typeOut = it.type;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ParseScanFilter(const char* name, ScanFilter& filterOut)
+{
+    for (auto& it : scan_filters) {
+        if (!strcmp(name, it.name)) {
+            filterOut = it.filter;
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename T>
+static void EncodeScanValue(T value, ScanValue& valueOut)
+{
+    valueOut.bytes.resize(sizeof(T));
+    memcpy(valueOut.bytes.data(), &value, sizeof(T));
+}
+
+bool ParseScanValue(ScanValueType type, const char* text, ScanValue& valueOut)
+{
+    valueOut.type = type;
+    valueOut.bytes.clear();
+    char* end = NULL;
+    switch (type) {
+    case ScanValueType::Int8:
+        EncodeScanValue((int8_t)strtoll(text, &end, 0), valueOut);
+        break;
+    case ScanValueType::Int16:
+        EncodeScanValue((int16_t)strtoll(text, &end, 0), valueOut);
+        break;
+    case ScanValueType::Int32:
+        EncodeScanValue((int32_t)strtoll(text, &end, 0), valueOut);
+        break;
+    case ScanValueType::Int64:
+        EncodeScanValue((int64_t)strtoll(text, &end, 0), valueOut);
+        break;
+    case ScanValueType::Float:
+        EncodeScanValue(strtof(text, &end), valueOut);
+        break;
+    case ScanValueType::Double:
+        EncodeScanValue(strtod(text, &end), valueOut);
+        break;
+    case ScanValueType::Bytes:
+        for (const char* p = text; *p;) {
+            if (isspace((unsigned char)*p)) {
+                p++;
+                continue;
+            }
+            int high = HexDigit(p[0]);
+            int low = high < 0 ? -1 : HexDigit(p[1]);
+            if (low < 0)
+                return false;
+            valueOut.bytes.push_back((uint8_t)(high << 4 | low));
+            p += 2;
+        }
+        return !valueOut.bytes.empty();
+    }
+    if (end == text)
+        return false;
+    while (isspace((unsigned char)*end))
+        end++;
+    return !*end;
+}
+
+template <typename T>
+static T LoadScanValue(const uint8_t* value)
+{
+    T out;
+    memcpy(&out, value, sizeof(T));
+    return out;
+}
+
+void FormatScanValue(ScanValueType type, const uint8_t* value, size_t size, char* out, size_t outSize)
+{
+    switch (type) {
+    case ScanValueType::Int8:
+        snprintf(out, outSize, "%d", LoadScanValue<int8_t>(value));
+        return;
+    case ScanValueType::Int16:
+        snprintf(out, outSize, "%d", LoadScanValue<int16_t>(value));
+        return;
+    case ScanValueType::Int32:
+        snprintf(out, outSize, "%d", LoadScanValue<int32_t>(value));
+        return;
+    case ScanValueType::Int64:
+        snprintf(out, outSize, "%lld", (long long)LoadScanValue<int64_t>(value));
+        return;
+    case ScanValueType::Float:
+        snprintf(out, outSize, "%g", LoadScanValue<float>(value));
+        return;
+    case ScanValueType::Double:
+        snprintf(out, outSize, "%g", LoadScanValue<double>(value));
+        return;
+    case ScanValueType::Bytes:
+        if (outSize)
+            *out = '\0';
+        for (size_t i = 0; i < size && (i + 1) * 3 < outSize; i++)
+            snprintf(out + i * 3, outSize - i * 3, i ? " %02x" : "%02x", value[i]);
+        return;
+    }
+}
+
+// NaNs compare equal to everything, so they never count as increased or
+// decreased
+template <typename T>
+static int CompareAs(const uint8_t* a, const uint8_t* b)
+{
+    T x = LoadScanValue<T>(a), y = LoadScanValue<T>(b);
+    return x < y ? -1 : (y < x ? 1 : 0);
+}
+
+int CompareScanValues(ScanValueType type, const uint8_t* a, const uint8_t* b, size_t size)
+{
+    switch (type) {
+    case ScanValueType::Int8:
+        return CompareAs<int8_t>(a, b);
+    case ScanValueType::Int16:
+        return CompareAs<int16_t>(a, b);
+    case ScanValueType::Int32:
+        return CompareAs<int32_t>(a, b);
+    case ScanValueType::Int64:
+        return CompareAs<int64_t>(a, b);
+    case ScanValueType::Float:
+        return CompareAs<float>(a, b);
+    case ScanValueType::Double:
+        return CompareAs<double>(a, b);
+    default:
+        return memcmp(a, b, size);
+    }
+}
+
+// The float types do their arithmetic in their own precision, so the SIMD
+// search below gets the same answers
+template <typename T>
+static bool FloatsEqual(T x, T y, T epsilon)
+{
+    return x == y || fabs(x - y) <= epsilon;
+}
+
+bool ScanValuesEqual(ScanValueType type, const uint8_t* a, const uint8_t* b, size_t size, double epsilon)
+{
+    switch (type) {
+    case ScanValueType::Float:
+        return FloatsEqual(LoadScanValue<float>(a), LoadScanValue<float>(b), (float)epsilon);
+    case ScanValueType::Double:
+        return FloatsEqual(LoadScanValue<double>(a), LoadScanValue<double>(b), epsilon);
+    default:
+        return !memcmp(a, b, size);
+    }
+}
+
+bool ScanFilterMatches(ScanFilter filter, ScanValueType type, const uint8_t* current, const uint8_t* previous, const uint8_t* value, size_t size, double epsilon)
+{
+    switch (filter) {
+    case ScanFilter::Equal:
+        return ScanValuesEqual(type, current, value, size, epsilon);
+    case ScanFilter::Changed:
+        return memcmp(current, previous, size) != 0;
+    case ScanFilter::Unchanged:
+        return !memcmp(current, previous, size);
+    case ScanFilter::Increased:
+        return CompareScanValues(type, current, previous, size) > 0;
+    default:
+        return CompareScanValues(type, current, previous, size) < 0;
+    }
+}
+
+size_t ScanValueSize(ScanValueType type)
+{
+    for (auto& it : scan_value_types) {
+        if (it.type == type)
+            return it.size;
+    }
+    return 0;
+}
+
+static void FindScanValueScalar(const uint8_t* data, size_t begin, size_t end, const std::vector<uint8_t>& value, size_t step, uint64_t base, std::vector<uint64_t>& offsetsOut)
+{
+    for (size_t offset = begin; offset < end; offset += step) {
+        if (data[offset] == value[0] && !memcmp(data + offset, value.data(), value.size()))
+            offsetsOut.push_back(base + offset);
+    }
+}
+
+template <typename T>
+static void FindScanFloatScalar(const uint8_t* data, size_t begin, size_t end, T value, T epsilon, size_t step, uint64_t base, std::vector<uint64_t>& offsetsOut)
+{
+    for (size_t offset = begin; offset < end; offset += step) {
+        if (FloatsEqual(LoadScanValue<T>(data + offset), value, epsilon))
+            offsetsOut.push_back(base + offset);
+    }
+}
+
+#ifdef SIMD_X86
+// One compare per element when the step is the element size, otherwise the
+// first and last byte of the value filter the positions that get a memcmp.
+// Returns how far it got, the scalar loop does the rest.
+SIMD_TARGET_AVX2
+static size_t FindScanValueAvx2(const uint8_t* data, size_t end, const std::vector<uint8_t>& value, size_t step, uint64_t base, std::vector<uint64_t>& offsetsOut)
+{
+    const size_t size = value.size();
+    size_t offset = 0;
+    if (step == size && (size == 1 || size == 2 || size == 4 || size == 8)) {
+        __m256i needle;
+        switch (size) {
+        case 1:
+            needle = _mm256_set1_epi8((char)value[0]);
+            break;
+        case 2:
+            needle = _mm256_set1_epi16((short)LoadScanValue<uint16_t>(value.data()));
+            break;
+        case 4:
+            needle = _mm256_set1_epi32((int)LoadScanValue<uint32_t>(value.data()));
+            break;
+        default:
+            needle = _mm256_set1_epi64x((long long)LoadScanValue<uint64_t>(value.data()));
+            break;
+        }
+        for (; offset + 32 <= end; offset += 32) {
+            __m256i block = _mm256_loadu_si256((const __m256i*)(data + offset));
+            uint32_t mask;
+            switch (size) {
+            case 1:
+                mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle));
+                break;
+            case 2:
+                // Both bytes of a 16-bit lane are set on a match, keep one
+                mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi16(block, needle)) & 0x55555555;
+                break;
+            case 4:
+                mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi32(block, needle)) & 0x11111111;
+                break;
+            default:
+                mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi64(block, needle)) & 0x01010101;
+                break;
+            }
+            for (; mask; mask &= mask - 1)
+                offsetsOut.push_back(base + offset + SimdLowestBit(mask));
+        }
+        return offset;
+    }
+
+    if (step != 1 || size < 2)
+        return 0;
+    const __m256i first = _mm256_set1_epi8((char)value[0]);
+    const __m256i last = _mm256_set1_epi8((char)value[size - 1]);
+    for (; offset + 32 <= end; offset += 32) {
+        __m256i blockFirst = _mm256_loadu_si256((const __m256i*)(data + offset));
+        __m256i blockLast = _mm256_loadu_si256((const __m256i*)(data + offset + size - 1));
+        __m256i match = _mm256_and_si256(_mm256_cmpeq_epi8(blockFirst, first), _mm256_cmpeq_epi8(blockLast, last));
+        for (uint32_t mask = (uint32_t)_mm256_movemask_epi8(match); mask; mask &= mask - 1) {
+            size_t at = offset + SimdLowestBit(mask);
+            if (!memcmp(data + at + 1, value.data() + 1, size - 2))
+                offsetsOut.push_back(base + at);
+        }
+    }
+    return offset;
+}
+
+// FloatsEqual() on a vector of values, aligned ones only. The absolute
+// difference is the difference with the sign bit cleared.
+SIMD_TARGET_AVX2
+static size_t FindScanFloatAvx2(const uint8_t* data, size_t end, float value, float epsilon, uint64_t base, std::vector<uint64_t>& offsetsOut)
+{
+    const __m256 needle = _mm256_set1_ps(value);
+    const __m256 tolerance = _mm256_set1_ps(epsilon);
+    const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    size_t offset = 0;
+    for (; offset + 32 <= end; offset += 32) {
+        __m256 block = _mm256_loadu_ps((const float*)(data + offset));
+        __m256 difference = _mm256_and_ps(_mm256_sub_ps(block, needle), absMask);
+        __m256 match = _mm256_or_ps(_mm256_cmp_ps(block, needle, _CMP_EQ_OQ), _mm256_cmp_ps(difference, tolerance, _CMP_LE_OQ));
+        for (uint32_t mask = (uint32_t)_mm256_movemask_ps(match); mask; mask &= mask - 1)
+            offsetsOut.push_back(base + offset + SimdLowestBit(mask) * sizeof(float));
+    }
+    return offset;
+}
+
+SIMD_TARGET_AVX2
+static size_t FindScanDoubleAvx2(const uint8_t* data, size_t end, double value, double epsilon, uint64_t base, std::vector<uint64_t>& offsetsOut)
+{
+    const __m256d needle = _mm256_set1_pd(value);
+    const __m256d tolerance = _mm256_set1_pd(epsilon);
+    const __m256d absMask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffll));
+    size_t offset = 0;
+    for (; offset + 32 <= end; offset += 32) {
+        __m256d block = _mm256_loadu_pd((const double*)(data + offset));
+        __m256d difference = _mm256_and_pd(_mm256_sub_pd(block, needle), absMask);
+        __m256d match = _mm256_or_pd(_mm256_cmp_pd(block, needle, _CMP_EQ_OQ), _mm256_cmp_pd(difference, tolerance, _CMP_LE_OQ));
+        for (uint32_t mask = (uint32_t)_mm256_movemask_pd(match); mask; mask &= mask - 1)
+            offsetsOut.push_back(base + offset + SimdLowestBit(mask) * sizeof(double));
+    }
+    return offset;
+}
+#endif
+
+void FindScanValue(const uint8_t* data, size_t end, const ScanValue& value, size_t step, uint64_t base, std::vector<uint64_t>& offsetsOut)
+{
+    if (value.bytes.empty() || !step)
+        return;
+    size_t begin = 0;
+    if (value.type == ScanValueType::Float) {
+        float number = LoadScanValue<float>(value.bytes.data());
+#ifdef SIMD_X86
+        if (SimdHasAvx2() && step == sizeof(float))
+            begin = FindScanFloatAvx2(data, end, number, (float)value.epsilon, base, offsetsOut);
+#endif
+        FindScanFloatScalar(data, begin, end, number, (float)value.epsilon, step, base, offsetsOut);
+        return;
+    }
+    if (value.type == ScanValueType::Double) {
+        double number = LoadScanValue<double>(value.bytes.data());
+#ifdef SIMD_X86
+        if (SimdHasAvx2() && step == sizeof(double))
+            begin = FindScanDoubleAvx2(data, end, number, value.epsilon, base, offsetsOut);
+#endif
+        FindScanFloatScalar(data, begin, end, number, value.epsilon, step, base, offsetsOut);
+        return;
+    }
+#ifdef SIMD_X86
+    if (SimdHasAvx2())
+        begin = FindScanValueAvx2(data, end, value.bytes, step, base, offsetsOut);
+#endif
+    FindScanValueScalar(data, begin, end, value.bytes, step, base, offsetsOut);
+}
+
+bool MemScanner::FirstScan(const ScanValue& value, unsigned int numThreads)
+{
+    type = value.type;
+    valueSize = value.bytes.size();
+    addresses.clear();
+    values.clear();
+    bytesScanned = 0;
+    if (!valueSize)
+        return false;
+
+    std::vector<RemoteRegion> regions;
+    {
+        RemoteReader reader(pid);
+        if (!reader.IsOpen() || !reader.EnumRegions(regions))
+            return false;
+    }
+
+    // Chunks overlap by valueSize - 1 bytes, so values across a chunk
+    // boundary are still found. Matches are only taken from the first
+    // `size` bytes of a chunk.
+    struct Chunk {
+        uint64_t address;
+        size_t size;
+        size_t readSize;
+    };
+    std::vector<Chunk> chunks;
+    for (auto& region : regions) {
+        for (uint64_t offset = 0; offset < region.size; offset += SCAN_CHUNK) {
+            size_t size = (size_t)std::min<uint64_t>(SCAN_CHUNK, region.size - offset);
+            size_t readSize = (size_t)std::min<uint64_t>(size + valueSize - 1, region.size - offset);
+            chunks.push_back({ region.address + offset, size, readSize });
+        }
+    }
+
+    size_t step = aligned && type != ScanValueType::Bytes ? valueSize : 1;
+    // Floats can match without being the same bytes, so the values are kept
+    // as read
+    std::vector<std::vector<uint64_t>> found(chunks.size());
+    std::vector<std::vector<uint8_t>> foundValues(chunks.size());
+    std::atomic<size_t> nextChunk { 0 };
+    std::atomic<uint64_t> scanned { 0 };
+    RunThreads(ThreadCount(numThreads, chunks.size()), [&](unsigned int) {
+        RemoteReader reader(pid);
+        std::vector<uint8_t> buffer(SCAN_CHUNK + valueSize);
+        for (size_t i; (i = nextChunk.fetch_add(1)) < chunks.size();) {
+            const Chunk& chunk = chunks[i];
+            if (chunk.readSize < valueSize || !reader.Read(chunk.address, buffer.data(), chunk.readSize))
+                continue;
+            size_t end = std::min(chunk.size, chunk.readSize - valueSize + 1);
+            FindScanValue(buffer.data(), end, value, step, chunk.address, found[i]);
+            foundValues[i].resize(found[i].size() * valueSize);
+            for (size_t k = 0; k < found[i].size(); k++)
+                memcpy(foundValues[i].data() + k * valueSize, buffer.data() + (found[i][k] - chunk.address), valueSize);
+            scanned += chunk.readSize;
+        }
+    });
+
+    size_t count = 0;
+    for (auto& chunkFound : found)
+        count += chunkFound.size();
+    addresses.reserve(count);
+    values.reserve(count * valueSize);
+    for (size_t i = 0; i < chunks.size(); i++) {
+        addresses.insert(addresses.end(), found[i].begin(), found[i].end());
+        values.insert(values.end(), foundValues[i].begin(), foundValues[i].end());
+    }
+    bytesScanned = scanned;
+    return true;
+}
+
+bool MemScanner::NextScan(ScanFilter filter, const ScanValue* value, unsigned int numThreads)
+{
+    if (filter == ScanFilter::Equal && (!value || value->bytes.size() != valueSize))
+        return false;
+    {
+        RemoteReader reader(pid);
+        if (!reader.IsOpen())
+            return false;
+    }
+
+    const uint8_t* filterValue = filter == ScanFilter::Equal ? value->bytes.data() : nullptr;
+    const double filterEpsilon = filter == ScanFilter::Equal ? value->epsilon : 0;
+
+    // Every thread narrows down its own slice of the candidates in place,
+    // the slices are moved together afterwards
+    const size_t count = addresses.size();
+    const unsigned int threads = ThreadCount(numThreads, count / SCAN_SPAN_BATCH + 1);
+    std::vector<size_t> kept(threads);
+    std::atomic<uint64_t> scanned { 0 };
+    auto sliceBegin = [&](unsigned int slice) { return count * slice / threads; };
+
+    RunThreads(threads, [&](unsigned int slice) {
+        RemoteReader reader(pid);
+        struct Span {
+            size_t first, last; // candidates [first, last)
+            size_t bufferOffset;
+            bool ok;
+        };
+        std::vector<Span> spans;
+        std::vector<uint8_t> buffer;
+        const size_t end = sliceBegin(slice + 1);
+        size_t out = sliceBegin(slice);
+        uint64_t sliceScanned = 0;
+
+        for (size_t i = sliceBegin(slice); i < end;) {
+            // Group the next candidates into spans, and read them in one batch
+            spans.clear();
+            size_t bufferSize = 0;
+            while (i < end && spans.size() < SCAN_SPAN_BATCH) {
+                size_t j = i + 1;
+                uint64_t spanEnd = addresses[i] + valueSize;
+                while (j < end && addresses[j] <= spanEnd + SCAN_SPAN_GAP && addresses[j] + valueSize - addresses[i] <= SCAN_SPAN_MAX) {
+                    spanEnd = std::max<uint64_t>(spanEnd, addresses[j] + valueSize);
+                    j++;
+                }
+                spans.push_back({ i, j, bufferSize, true });
+                bufferSize += (size_t)(spanEnd - addresses[i]);
+                i = j;
+            }
+            buffer.resize(bufferSize);
+            auto spanSize = [&](const Span& span) {
+                return (size_t)(addresses[span.last - 1] + valueSize - addresses[span.first]);
+            };
+            for (auto& span : spans)
+                reader.Add(addresses[span.first], buffer.data() + span.bufferOffset, spanSize(span));
+            if (!reader.Flush()) {
+                // Something in the batch is gone, find out what
+                for (auto& span : spans)
+                    span.ok = reader.Read(addresses[span.first], buffer.data() + span.bufferOffset, spanSize(span));
+            }
+            sliceScanned += bufferSize;
+
+            for (auto& span : spans) {
+                if (!span.ok)
+                    continue;
+                for (size_t k = span.first; k < span.last; k++) {
+                    const uint8_t* current = buffer.data() + span.bufferOffset + (addresses[k] - addresses[span.first]);
+                    const uint8_t* previous = values.data() + k * valueSize;
+                    if (ScanFilterMatches(filter, type, current, previous, filterValue, valueSize, filterEpsilon)) {
+                        addresses[out] = addresses[k];
+                        memcpy(values.data() + out * valueSize, current, valueSize);
+                        out++;
+                    }
+                }
+            }
+        }
+        kept[slice] = out - sliceBegin(slice);
+        scanned += sliceScanned;
+    });
+
+    size_t total = 0;
+    for (unsigned int slice = 0; slice < threads; slice++) {
+        size_t begin = sliceBegin(slice);
+        if (total != begin) {
+            memmove(addresses.data() + total, addresses.data() + begin, kept[slice] * sizeof(uint64_t));
+            memmove(values.data() + total * valueSize, values.data() + begin * valueSize, kept[slice] * valueSize);
+        }
+        total += kept[slice];
+    }
+    addresses.resize(total);
+    values.resize(total * valueSize);
+    bytesScanned = scanned;
+    return true;
+}
+
+static void PrintMemScanUsage()
+{
+    fprintf(stderr,
+        "usage: mem-scan [-j threads] [-e epsilon] [--unaligned] <pid> <type> [value]\n"
+        "  Scans the readable memory of a process for a value, then reads more\n"
+        "  commands from stdin to narrow the results down. Without a value, it\n"
+        "  snapshots the writable memory and the first next compares against that,\n"
+        "  which can't be unchanged.\n"
+        "    next <changed|unchanged|inc|dec>\n"
+        "    next eq <value>\n"
+        "    list [count]\n"
+        "    quit\n"
+        "  types: i8 i16 i32 i64 float double bytes (hex pairs, e.g. \"8b 0d\")\n"
+        "  -e           floats this close to the value count as equal\n"
+        "  --unaligned  also look for numbers at addresses that aren't a multiple\n"
+        "               of their size\n");
+}
+
+static void PrintMemScanResults(const MemScanner& scanner, size_t limit)
+{
+    char text[128];
+    for (size_t i = 0; i < scanner.Count() && i < limit; i++) {
+        FormatScanValue(scanner.type, scanner.Value(i), scanner.valueSize, text, sizeof(text));
+        printf("%08llx  %s\n", (unsigned long long)scanner.addresses[i], text);
+    }
+}
+
+int mem_scan_cli(int argc, char** argv)
+{
+    unsigned int numThreads = 0;
+    bool aligned = true;
+    double epsilon = 0;
+    std::vector<const char*> args;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-j") && i + 1 < argc)
+            numThreads = (unsigned int)strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "-e") && i + 1 < argc)
+            epsilon = strtod(argv[++i], NULL);
+        else if (!strcmp(argv[i], "--unaligned"))
+            aligned = false;
+        else
+            args.push_back(argv[i]);
+    }
+    ScanValueType type;
+    if (args.size() < 2 || !ParseScanValueType(args[1], type)) {
+        PrintMemScanUsage();
+        return 1;
+    }
+    std::string valueText;
+    for (size_t i = 2; i < args.size(); i++)
+        valueText += std::string(i > 2 ? " " : "") + args[i];
+    ScanValue value;
+    value.epsilon = epsilon;
+    if (!valueText.empty() && !ParseScanValue(type, valueText.c_str(), value)) {
+        fprintf(stderr, "Error: Couldn't parse %s\n", valueText.c_str());
+        return 1;
+    }
+
+    uint32_t pid = (uint32_t)strtoul(args[0], NULL, 10);
+    MemScanner scanner(pid);
+    scanner.aligned = aligned;
+    auto start = std::chrono::steady_clock::now();
+    auto report = [&]() {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("%zu results, %.1f MiB read in %.3fs\n", scanner.Count(), scanner.bytesScanned / 1048576.0, seconds);
+        fflush(stdout);
+    };
+
+    // Unknown initial value: everything is a candidate until the first next
+    std::unique_ptr<SnapshotStore> store;
+    MemSnapshot snapshot;
+    if (valueText.empty()) {
+        if (type == ScanValueType::Bytes) {
+            fprintf(stderr, "Error: Byte patterns need a value\n");
+            return 1;
+        }
+        store = std::make_unique<SnapshotStore>();
+        if (!TakeSnapshot(pid, *store, numThreads, snapshot)) {
+            fprintf(stderr, "Error: Couldn't read the memory of process %s\n", args[0]);
+            return 1;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("snapshot of %.1f MiB in %.3fs, %.1f MiB stored\n", snapshot.bytesRead / 1048576.0, seconds,
+            store->PageCount() * SNAPSHOT_PAGE_SIZE / 1048576.0);
+        fflush(stdout);
+    } else {
+        if (!scanner.FirstScan(value, numThreads)) {
+            fprintf(stderr, "Error: Couldn't read the memory of process %s\n", args[0]);
+            return 1;
+        }
+        report();
+    }
+
+    char line[1024];
+    while (fgets(line, sizeof(line), stdin)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char command[16] = {}, filterName[16] = {};
+        int consumed = 0;
+        if (sscanf(line, "%15s %n", command, &consumed) < 1)
+            continue;
+        const char* rest = line + consumed;
+        if (!strcmp(command, "quit")) {
+            break;
+        } else if (!strcmp(command, "list")) {
+            PrintMemScanResults(scanner, *rest ? strtoul(rest, NULL, 10) : 20);
+        } else if (!strcmp(command, "next") && sscanf(rest, "%15s %n", filterName, &consumed) >= 1) {
+            ScanFilter filter;
+            if (!ParseScanFilter(filterName, filter)) {
+                fprintf(stderr, "Error: Unknown filter %s\n", filterName);
+                continue;
+            }
+            if (filter == ScanFilter::Equal && !ParseScanValue(type, rest + consumed, value)) {
+                fprintf(stderr, "Error: Couldn't parse %s\n", rest + consumed);
+                continue;
+            }
+            if (store && filter == ScanFilter::Unchanged) {
+                fprintf(stderr, "Error: Unchanged only narrows down results, start with changed, inc or dec\n");
+                continue;
+            }
+            start = std::chrono::steady_clock::now();
+            bool ok;
+            if (store && filter == ScanFilter::Equal) {
+                ok = scanner.FirstScan(value, numThreads);
+            } else if (store) {
+                MemSnapshot after;
+                ok = TakeSnapshot(pid, *store, numThreads, after) && DiffSnapshots(*store, snapshot, after, type, filter, numThreads, scanner);
+            } else {
+                ok = scanner.NextScan(filter, &value, numThreads);
+            }
+            if (!ok) {
+                fprintf(stderr, "Error: Couldn't read the memory of process %s\n", args[0]);
+                continue;
+            }
+            store.reset();
+            report();
+        } else {
+            fprintf(stderr, "Error: Unknown command %s\n", line);
+        }
+    }
+    return 0;
+}
+
+#ifdef _WIN32
+#include <imgui.h>
+#include "window.h"
+
+void mem_scan_gui()
+{
+    static int pid = 0;
+    static int typeIndex = 2;
+    static int filterIndex = 0;
+    static char valueText[256] = {};
+    static double epsilon = 0;
+    static std::unique_ptr<MemScanner> scanner;
+
+    ImGui::TextUnformatted(
+        "Finds values in the memory of a running game. Narrow the results down with next scans\n"
+        "after the value changed in game, until only the address you're looking for is left"
+    );
+    ImGui::InputInt("Process ID", &pid);
+    const char* typeNames[IM_ARRAYSIZE(scan_value_types)];
+    for (size_t i = 0; i < IM_ARRAYSIZE(scan_value_types); i++)
+        typeNames[i] = scan_value_types[i].name;
+    ImGui::Combo("Type", &typeIndex, typeNames, IM_ARRAYSIZE(typeNames));
+    ImGui::InputText("Value", valueText, sizeof(valueText));
+    ScanValueType type = scan_value_types[typeIndex].type;
+    if (type == ScanValueType::Float || type == ScanValueType::Double)
+        ImGui::InputDouble("Epsilon", &epsilon, 0.0, 0.0, "%g");
+
+    ScanValue value;
+    value.epsilon = epsilon;
+    if (ImGui::Button("First scan")) {
+        if (!ParseScanValue(type, valueText, value)) {
+            MessageBoxW(GuiGetWindow(), L"Couldn't parse the value", L"Memory scan", MB_ICONERROR);
+        } else {
+            scanner = std::make_unique<MemScanner>((uint32_t)pid);
+            if (!scanner->FirstScan(value, 0)) {
+                scanner.reset();
+                MessageBoxW(GuiGetWindow(), L"Couldn't read the memory of that process", L"Memory scan", MB_ICONERROR);
+            }
+        }
+    }
+    if (!scanner)
+        return;
+
+    ImGui::SameLine();
+    const char* filterNames[IM_ARRAYSIZE(scan_filters)];
+    for (size_t i = 0; i < IM_ARRAYSIZE(scan_filters); i++)
+        filterNames[i] = scan_filters[i].name;
+    ImGui::SetNextItemWidth(120.0f);
+    ImGui::Combo("##filter", &filterIndex, filterNames, IM_ARRAYSIZE(filterNames));
+    ImGui::SameLine();
+    if (ImGui::Button("Next scan")) {
+        ScanFilter filter = scan_filters[filterIndex].filter;
+        if (filter == ScanFilter::Equal && !ParseScanValue(scanner->type, valueText, value))
+            MessageBoxW(GuiGetWindow(), L"Couldn't parse the value", L"Memory scan", MB_ICONERROR);
+        else if (!scanner->NextScan(filter, &value, 0))
+            MessageBoxW(GuiGetWindow(), L"Couldn't read the memory of that process", L"Memory scan", MB_ICONERROR);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Reset")) {
+        scanner.reset();
+        return;
+    }
+
+    ImGui::Text("%zu results", scanner->Count());
+    ImGui::BeginChild("results");
+    ImGuiListClipper clipper;
+    clipper.Begin((int)std::min<size_t>(scanner->Count(), INT_MAX));
+    char text[128];
+    while (clipper.Step()) {
+        for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+            FormatScanValue(scanner->type, scanner->Value(i), scanner->valueSize, text, sizeof(text));
+            ImGui::Text("%08llx  %s", (unsigned long long)scanner->addresses[i], text);
+        }
+    }
+    ImGui::EndChild();
+}
+#endif
@@ -0,0 +1,80 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+enum class ScanValueType {
+    Int8,
+    Int16,
+    Int32,
+    Int64,
+    Float,
+    Double,
+    Bytes,
+};
+
+// What a next scan keeps, compared to the value from the previous scan
+enum class ScanFilter {
+    Equal, // equal to a new value
+    Changed,
+    Unchanged,
+    Increased,
+    Decreased,
+};
+
+struct ScanValue {
+    ScanValueType type = ScanValueType::Int32;
+    // Little endian encoding, or the pattern for Bytes
+    std::vector<uint8_t> bytes;
+    // Floats this close to the value are equal to it. They're compared as
+    // numbers either way, so 0 also finds -0.0.
+    double epsilon = 0;
+};
+
+bool ParseScanValueType(const char* name, ScanValueType& typeOut);
+bool ParseScanFilter(const char* name, ScanFilter& filterOut);
+// Numbers in C syntax (0x for hex), Bytes as hex pairs like "8b 0d". The
+// epsilon is left as it is.
+bool ParseScanValue(ScanValueType type, const char* text, ScanValue& valueOut);
+void FormatScanValue(ScanValueType type, const uint8_t* value, size_t size, char* out, size_t outSize);
+// Size of one value of `type`, 0 for Bytes
+size_t ScanValueSize(ScanValueType type);
+// <0, 0 or >0 like memcmp, but by the numeric value of `type`
+int CompareScanValues(ScanValueType type, const uint8_t* a, const uint8_t* b, size_t size);
+// Whether `a` equals `b`, by value for floats, see ScanValue::epsilon
+bool ScanValuesEqual(ScanValueType type, const uint8_t* a, const uint8_t* b, size_t size, double epsilon);
+// Whether a value that was `previous` and now is `current` passes `filter`.
+// `value` and `epsilon` are only used by ScanFilter::Equal.
+bool ScanFilterMatches(ScanFilter filter, ScanValueType type, const uint8_t* current, const uint8_t* previous, const uint8_t* value, size_t size, double epsilon = 0);
+
+// Cheat Engine style value scanner over the readable memory of a process.
+// The first scan searches every region, split in chunks across threads.
+// Next scans re-read only the candidates and narrow them down in place.
+struct MemScanner {
+    uint32_t pid;
+    ScanValueType type = ScanValueType::Int32;
+    size_t valueSize = 0;
+    // Numbers are only looked for at multiples of their size
+    bool aligned = true;
+    // Candidates, sorted by address, and their values as of the last scan
+    std::vector<uint64_t> addresses;
+    std::vector<uint8_t> values;
+    uint64_t bytesScanned = 0;
+
+    MemScanner(uint32_t pid)
+        : pid(pid)
+    {
+    }
+
+    bool FirstScan(const ScanValue& value, unsigned int numThreads);
+    // `value` is only needed for ScanFilter::Equal
+    bool NextScan(ScanFilter filter, const ScanValue* value, unsigned int numThreads);
+    size_t Count() const { return addresses.size(); }
+    const uint8_t* Value(size_t i) const { return values.data() + i * valueSize; }
+};
+
+// Offsets of `value` in `data`, at multiples of `step`, appended to
+// `offsetsOut` with `base` added. Only matches starting below `end` count,
+// `data` must hold value.size() - 1 more bytes than that. Floats are
+// matched by value, everything else byte for byte.
+void FindScanValue(const uint8_t* data, size_t end, const ScanValue& value, size_t step, uint64_t base, std::vector<uint64_t>& offsetsOut);
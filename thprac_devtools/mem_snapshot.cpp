@@ -0,0 +1,253 @@
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <parallel.h>
+#include <simd.h>
+#include "metrohash128mb.h"
+#include "mem_snapshot.h"
+
+// Pages per unit of work, for taking snapshots as well as diffing them
+constexpr size_t SNAPSHOT_CHUNK_PAGES = 1024;
+
+uint32_t SnapshotStore::AddPage(const uint8_t* data, const uint64_t hash[2])
+{
+    PageKey key = { hash[0], hash[1] };
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(key);
+    // A 128-bit collision won't happen, but checking costs next to nothing
+    if (it != index.end() && !memcmp(Page(it->second), data, SNAPSHOT_PAGE_SIZE))
+        return it->second;
+
+    uint32_t id = (uint32_t)pageCount++;
+    if (id / PAGES_PER_BLOCK >= blocks.size())
+        blocks.emplace_back(new uint8_t[PAGES_PER_BLOCK * SNAPSHOT_PAGE_SIZE]);
+    memcpy(blocks[id / PAGES_PER_BLOCK].get() + (id % PAGES_PER_BLOCK) * SNAPSHOT_PAGE_SIZE, data, SNAPSHOT_PAGE_SIZE);
+    if (it == index.end())
+        index.emplace(key, id);
+    return id;
+}
+
+uint32_t MemSnapshot::PageAt(uint64_t address) const
+{
+    auto it = std::upper_bound(regions.begin(), regions.end(), address, [](uint64_t address, const RemoteRegion& region) {
+        return address < region.address;
+    });
+    if (it == regions.begin())
+        return SNAPSHOT_MISSING_PAGE;
+    --it;
+    if (address - it->address >= it->size)
+        return SNAPSHOT_MISSING_PAGE;
+    return pageIds[firstPage[it - regions.begin()] + (size_t)((address - it->address) / SNAPSHOT_PAGE_SIZE)];
+}
+
+// A run of pages of one region
+struct SnapshotChunk {
+    size_t region;
+    size_t firstPage; // within the region
+    size_t pageCount;
+};
+
+static std::vector<SnapshotChunk> SplitSnapshot(const MemSnapshot& snapshot)
+{
+    std::vector<SnapshotChunk> chunks;
+    for (size_t i = 0; i < snapshot.regions.size(); i++) {
+        size_t pages = (size_t)(snapshot.regions[i].size / SNAPSHOT_PAGE_SIZE);
+        for (size_t page = 0; page < pages; page += SNAPSHOT_CHUNK_PAGES)
+            chunks.push_back({ i, page, std::min(SNAPSHOT_CHUNK_PAGES, pages - page) });
+    }
+    return chunks;
+}
+
+bool TakeSnapshot(uint32_t pid, SnapshotStore& store, unsigned int numThreads, MemSnapshot& snapshotOut)
+{
+    snapshotOut = {};
+    std::vector<RemoteRegion> regions;
+    {
+        RemoteReader reader(pid);
+        if (!reader.IsOpen() || !reader.EnumRegions(regions))
+            return false;
+    }
+    size_t pageCount = 0;
+    for (auto& region : regions) {
+        if (!region.writable)
+            continue;
+        snapshotOut.regions.push_back(region);
+        snapshotOut.firstPage.push_back(pageCount);
+        pageCount += (size_t)(region.size / SNAPSHOT_PAGE_SIZE);
+    }
+    snapshotOut.pageIds.assign(pageCount, SNAPSHOT_MISSING_PAGE);
+
+    auto chunks = SplitSnapshot(snapshotOut);
+    std::atomic<size_t> nextChunk { 0 };
+    std::atomic<uint64_t> bytesRead { 0 };
+    RunThreads(ThreadCount(numThreads, chunks.size()), [&](unsigned int) {
+        RemoteReader reader(pid);
+        std::vector<uint8_t> buffer(SNAPSHOT_CHUNK_PAGES * SNAPSHOT_PAGE_SIZE);
+        std::vector<char> pageOk;
+        std::vector<const uint8_t*> pages;
+        std::vector<uint64_t> lengths;
+        std::vector<uint64_t> hashes;
+        std::vector<uint8_t*> hashPtrs;
+        for (size_t c; (c = nextChunk.fetch_add(1)) < chunks.size();) {
+            const SnapshotChunk& chunk = chunks[c];
+            uint64_t address = snapshotOut.regions[chunk.region].address + chunk.firstPage * SNAPSHOT_PAGE_SIZE;
+            size_t size = chunk.pageCount * SNAPSHOT_PAGE_SIZE;
+            pageOk.assign(chunk.pageCount, 1);
+            if (!reader.Read(address, buffer.data(), size)) {
+                // Some page of it went away, keep what's still there
+                for (size_t i = 0; i < chunk.pageCount; i++)
+                    pageOk[i] = reader.Read(address + i * SNAPSHOT_PAGE_SIZE, buffer.data() + i * SNAPSHOT_PAGE_SIZE, SNAPSHOT_PAGE_SIZE);
+            }
+
+            pages.clear();
+            for (size_t i = 0; i < chunk.pageCount; i++) {
+                if (pageOk[i])
+                    pages.push_back(buffer.data() + i * SNAPSHOT_PAGE_SIZE);
+            }
+            lengths.assign(pages.size(), SNAPSHOT_PAGE_SIZE);
+            hashes.resize(pages.size() * 2);
+            hashPtrs.resize(pages.size());
+            for (size_t i = 0; i < pages.size(); i++)
+                hashPtrs[i] = (uint8_t*)&hashes[i * 2];
+            MetroHash128MB::Hash(pages.data(), lengths.data(), hashPtrs.data(), pages.size());
+
+            uint32_t* ids = snapshotOut.pageIds.data() + snapshotOut.firstPage[chunk.region] + chunk.firstPage;
+            size_t hashed = 0;
+            for (size_t i = 0; i < chunk.pageCount; i++) {
+                if (!pageOk[i])
+                    continue;
+                ids[i] = store.AddPage(pages[hashed], &hashes[hashed * 2]);
+                hashed++;
+            }
+            bytesRead += pages.size() * SNAPSHOT_PAGE_SIZE;
+        }
+    });
+    snapshotOut.bytesRead = bytesRead;
+    return true;
+}
+
+static void DiffPageScalar(const uint8_t* before, const uint8_t* after, ScanValueType type, ScanFilter filter, size_t step, uint64_t address, std::vector<uint64_t>& out)
+{
+    for (size_t offset = 0; offset < SNAPSHOT_PAGE_SIZE; offset += step) {
+        if (ScanFilterMatches(filter, type, after + offset, before + offset, nullptr, step))
+            out.push_back(address + offset);
+    }
+}
+
+#ifdef SIMD_X86
+// Byte mask of the lanes where `after` passes `filter` against `before`.
+// The caller keeps one bit per element.
+SIMD_TARGET_AVX2
+static inline uint32_t DiffBlockAvx2(__m256i before, __m256i after, ScanValueType type, ScanFilter filter)
+{
+    __m256i result;
+    if (filter == ScanFilter::Changed) {
+        switch (type) {
+        case ScanValueType::Int8:
+            result = _mm256_cmpeq_epi8(after, before);
+            break;
+        case ScanValueType::Int16:
+            result = _mm256_cmpeq_epi16(after, before);
+            break;
+        case ScanValueType::Int32:
+        case ScanValueType::Float:
+            result = _mm256_cmpeq_epi32(after, before);
+            break;
+        default:
+            result = _mm256_cmpeq_epi64(after, before);
+            break;
+        }
+        return ~(uint32_t)_mm256_movemask_epi8(result);
+    }
+
+    __m256i greater = filter == ScanFilter::Increased ? after : before;
+    __m256i lesser = filter == ScanFilter::Increased ? before : after;
+    switch (type) {
+    case ScanValueType::Int8:
+        result = _mm256_cmpgt_epi8(greater, lesser);
+        break;
+    case ScanValueType::Int16:
+        result = _mm256_cmpgt_epi16(greater, lesser);
+        break;
+    case ScanValueType::Int32:
+        result = _mm256_cmpgt_epi32(greater, lesser);
+        break;
+    case ScanValueType::Int64:
+        result = _mm256_cmpgt_epi64(greater, lesser);
+        break;
+    case ScanValueType::Float:
+        result = _mm256_castps_si256(_mm256_cmp_ps(_mm256_castsi256_ps(greater), _mm256_castsi256_ps(lesser), _CMP_GT_OQ));
+        break;
+    default:
+        result = _mm256_castpd_si256(_mm256_cmp_pd(_mm256_castsi256_pd(greater), _mm256_castsi256_pd(lesser), _CMP_GT_OQ));
+        break;
+    }
+    return (uint32_t)_mm256_movemask_epi8(result);
+}
+
+SIMD_TARGET_AVX2
+static void DiffPageAvx2(const uint8_t* before, const uint8_t* after, ScanValueType type, ScanFilter filter, size_t step, uint64_t address, std::vector<uint64_t>& out)
+{
+    // Lowest byte of every element
+    const uint32_t elementMask = step == 1 ? 0xffffffff : step == 2 ? 0x55555555 : step == 4 ? 0x11111111 : 0x01010101;
+    for (size_t offset = 0; offset < SNAPSHOT_PAGE_SIZE; offset += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(before + offset));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(after + offset));
+        for (uint32_t mask = DiffBlockAvx2(a, b, type, filter) & elementMask; mask; mask &= mask - 1)
+            out.push_back(address + offset + SimdLowestBit(mask));
+    }
+}
+#endif
+
+static void DiffPage(const uint8_t* before, const uint8_t* after, ScanValueType type, ScanFilter filter, size_t step, uint64_t address, std::vector<uint64_t>& out)
+{
+#ifdef SIMD_X86
+    if (SimdHasAvx2()) {
+        DiffPageAvx2(before, after, type, filter, step, address, out);
+        return;
+    }
+#endif
+    DiffPageScalar(before, after, type, filter, step, address, out);
+}
+
+bool DiffSnapshots(const SnapshotStore& store, const MemSnapshot& before, const MemSnapshot& after,
+    ScanValueType type, ScanFilter filter, unsigned int numThreads, MemScanner& scannerOut)
+{
+    size_t step = ScanValueSize(type);
+    if (!step || filter == ScanFilter::Equal || filter == ScanFilter::Unchanged)
+        return false;
+
+    auto chunks = SplitSnapshot(after);
+    std::vector<std::vector<uint64_t>> found(chunks.size());
+    std::atomic<size_t> nextChunk { 0 };
+    RunThreads(ThreadCount(numThreads, chunks.size()), [&](unsigned int) {
+        for (size_t c; (c = nextChunk.fetch_add(1)) < chunks.size();) {
+            const SnapshotChunk& chunk = chunks[c];
+            const uint32_t* ids = after.pageIds.data() + after.firstPage[chunk.region] + chunk.firstPage;
+            uint64_t address = after.regions[chunk.region].address + chunk.firstPage * SNAPSHOT_PAGE_SIZE;
+            for (size_t i = 0; i < chunk.pageCount; i++, address += SNAPSHOT_PAGE_SIZE) {
+                uint32_t afterId = ids[i];
+                uint32_t beforeId = before.PageAt(address);
+                // Same contents, nothing in it changed
+                if (afterId == SNAPSHOT_MISSING_PAGE || beforeId == SNAPSHOT_MISSING_PAGE || afterId == beforeId)
+                    continue;
+                DiffPage(store.Page(beforeId), store.Page(afterId), type, filter, step, address, found[c]);
+            }
+        }
+    });
+
+    scannerOut.type = type;
+    scannerOut.valueSize = step;
+    scannerOut.aligned = true;
+    scannerOut.addresses.clear();
+    for (auto& chunkFound : found)
+        scannerOut.addresses.insert(scannerOut.addresses.end(), chunkFound.begin(), chunkFound.end());
+    scannerOut.values.resize(scannerOut.addresses.size() * step);
+    for (size_t i = 0; i < scannerOut.addresses.size(); i++) {
+        uint64_t address = scannerOut.addresses[i];
+        const uint8_t* page = store.Page(after.PageAt(address));
+        memcpy(scannerOut.values.data() + i * step, page + address % SNAPSHOT_PAGE_SIZE, step);
+    }
+    scannerOut.bytesScanned = after.bytesRead;
+    return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <remote_reader.h>
+#include "mem_scan.h"
+
+constexpr size_t SNAPSHOT_PAGE_SIZE = RemoteReader::READ_PAGE_SIZE;
+constexpr uint32_t SNAPSHOT_MISSING_PAGE = UINT32_MAX;
+
+// Page contents shared by any number of snapshots. Pages are deduplicated
+// by their MetroHash128, so the zero pages and the memory a game never
+// touches between two snapshots are only stored once.
+struct SnapshotStore {
+    // Stores the page if it's new, returns its id either way. Thread safe,
+    // but must not run concurrently with Page().
+    uint32_t AddPage(const uint8_t* data, const uint64_t hash[2]);
+    const uint8_t* Page(uint32_t id) const
+    {
+        return blocks[id / PAGES_PER_BLOCK].get() + (id % PAGES_PER_BLOCK) * SNAPSHOT_PAGE_SIZE;
+    }
+    size_t PageCount() const { return pageCount; }
+
+private:
+    static constexpr size_t PAGES_PER_BLOCK = 256;
+    struct PageKey {
+        uint64_t lo, hi;
+        bool operator==(const PageKey& other) const { return lo == other.lo && hi == other.hi; }
+    };
+    struct PageKeyHash {
+        size_t operator()(const PageKey& key) const { return (size_t)(key.lo ^ key.hi); }
+    };
+
+    std::mutex mutex;
+    std::unordered_map<PageKey, uint32_t, PageKeyHash> index;
+    std::vector<std::unique_ptr<uint8_t[]>> blocks;
+    size_t pageCount = 0;
+};
+
+// The writable memory of a process at one point in time, as page ids into
+// a SnapshotStore
+struct MemSnapshot {
+    std::vector<RemoteRegion> regions;
+    // Index of each region's first page in pageIds
+    std::vector<size_t> firstPage;
+    std::vector<uint32_t> pageIds;
+    uint64_t bytesRead = 0;
+
+    // Id of the page holding `address`, or SNAPSHOT_MISSING_PAGE
+    uint32_t PageAt(uint64_t address) const;
+};
+
+bool TakeSnapshot(uint32_t pid, SnapshotStore& store, unsigned int numThreads, MemSnapshot& snapshotOut);
+
+// Compares every aligned value of `type` between two snapshots and puts the
+// ones that pass `filter` into `scannerOut`, with their values from `after`.
+// Pages that didn't change are skipped without looking at them. Equal and
+// Unchanged aren't supported: unchanged would make a candidate of nearly
+// every value in memory, it's only useful to narrow down a MemScanner.
+bool DiffSnapshots(const SnapshotStore& store, const MemSnapshot& before, const MemSnapshot& after,
+    ScanValueType type, ScanFilter filter, unsigned int numThreads, MemScanner& scannerOut);
@@ -0,0 +1,443 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <util.h>
+#include <parallel.h>
+#include <pe.h>
+#include "exe_sig.h"
+#include "ptr_scan.h"
+
+constexpr char PTR_FILE_MAGIC[4] = { 'T', 'P', 'T', 'R' };
+constexpr uint32_t PTR_FILE_VERSION = 1;
+
+struct PtrFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t ptrSize;
+    uint32_t moduleTimeStamp;
+    uint32_t count;
+};
+
+static uint64_t LoadPtr(const uint8_t* data, unsigned int ptrSize)
+{
+    if (ptrSize == 4) {
+        uint32_t value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+std::vector<PtrIndexEntry> BuildPtrIndex(const SnapshotStore& store, const MemSnapshot& snapshot, unsigned int ptrSize, unsigned int numThreads)
+{
+    // Pages hold pointers at the same offsets in every region, so the work
+    // is split by page
+    const size_t pageCount = snapshot.pageIds.size();
+    if (!pageCount)
+        return {};
+    const size_t pagesPerTask = 1024;
+    const size_t taskCount = (pageCount + pagesPerTask - 1) / pagesPerTask;
+    std::vector<size_t> pageRegion(pageCount);
+    for (size_t r = 0; r < snapshot.regions.size(); r++) {
+        size_t end = r + 1 < snapshot.regions.size() ? snapshot.firstPage[r + 1] : pageCount;
+        std::fill(pageRegion.begin() + snapshot.firstPage[r], pageRegion.begin() + end, r);
+    }
+
+    std::vector<std::vector<PtrIndexEntry>> found(taskCount);
+    std::atomic<size_t> nextTask { 0 };
+    RunThreads(ThreadCount(numThreads, taskCount), [&](unsigned int) {
+        for (size_t t; (t = nextTask.fetch_add(1)) < taskCount;) {
+            for (size_t p = t * pagesPerTask; p < std::min(pageCount, (t + 1) * pagesPerTask); p++) {
+                if (snapshot.pageIds[p] == SNAPSHOT_MISSING_PAGE)
+                    continue;
+                const RemoteRegion& region = snapshot.regions[pageRegion[p]];
+                uint64_t address = region.address + (p - snapshot.firstPage[pageRegion[p]]) * SNAPSHOT_PAGE_SIZE;
+                const uint8_t* page = store.Page(snapshot.pageIds[p]);
+                for (size_t offset = 0; offset < SNAPSHOT_PAGE_SIZE; offset += ptrSize) {
+                    uint64_t value = LoadPtr(page + offset, ptrSize);
+                    // Cheap rejects first, most values are small integers or zero
+                    if (value < snapshot.regions.front().address || value >= snapshot.regions.back().address + snapshot.regions.back().size)
+                        continue;
+                    if (snapshot.PageAt(value) != SNAPSHOT_MISSING_PAGE)
+                        found[t].push_back({ value, address + offset });
+                }
+            }
+        }
+    });
+
+    std::vector<PtrIndexEntry> index;
+    size_t count = 0;
+    for (auto& taskFound : found)
+        count += taskFound.size();
+    index.reserve(count);
+    for (auto& taskFound : found)
+        index.insert(index.end(), taskFound.begin(), taskFound.end());
+    std::sort(index.begin(), index.end(), [](const PtrIndexEntry& a, const PtrIndexEntry& b) {
+        return a.value != b.value ? a.value < b.value : a.address < b.address;
+    });
+    return index;
+}
+
+namespace {
+// An address some chain has to reach, and the offsets from it to the target
+struct PtrScanTask {
+    uint64_t address;
+    uint32_t depth;
+    uint32_t offsets[PTR_SCAN_MAX_DEPTH]; // target side first
+};
+
+// Per-thread task deques. The owner works depth first from the back, idle
+// threads steal from the front, where the tasks closest to the target sit
+// and so carry the most work.
+struct PtrScanQueues {
+    struct Queue {
+        std::mutex mutex;
+        std::deque<PtrScanTask> tasks;
+    };
+    std::vector<Queue> queues;
+    std::atomic<size_t> pending { 0 };
+
+    PtrScanQueues(unsigned int numThreads)
+        : queues(numThreads)
+    {
+    }
+
+    void Push(unsigned int self, const PtrScanTask& task)
+    {
+        pending++;
+        std::lock_guard<std::mutex> lock(queues[self].mutex);
+        queues[self].tasks.push_back(task);
+    }
+
+    bool Pop(unsigned int self, PtrScanTask& task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(queues[self].mutex);
+            if (!queues[self].tasks.empty()) {
+                task = queues[self].tasks.back();
+                queues[self].tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < queues.size(); i++) {
+            Queue& victim = queues[(self + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.front();
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+};
+}
+
+std::vector<PtrChain> FindPtrChains(const std::vector<PtrIndexEntry>& index, uint64_t target,
+    uint64_t moduleBase, uint64_t moduleSize, const PtrScanOptions& options)
+{
+    unsigned int maxDepth = std::min(options.maxDepth, PTR_SCAN_MAX_DEPTH);
+    unsigned int numThreads = ThreadCount(options.numThreads, SIZE_MAX);
+    PtrScanQueues queues(numThreads);
+    std::atomic<size_t> resultCount { 0 };
+    std::vector<std::vector<PtrChain>> results(numThreads);
+
+    PtrScanTask first = {};
+    first.address = target;
+    queues.Push(0, first);
+
+    RunThreads(numThreads, [&](unsigned int self) {
+        PtrScanTask task;
+        while (queues.pending && resultCount < options.maxResults) {
+            if (!queues.Pop(self, task)) {
+                std::this_thread::yield();
+                continue;
+            }
+            uint64_t lowest = task.address > options.maxOffset ? task.address - options.maxOffset : 0;
+            auto it = std::lower_bound(index.begin(), index.end(), lowest, [](const PtrIndexEntry& entry, uint64_t value) {
+                return entry.value < value;
+            });
+            for (; it != index.end() && it->value <= task.address; ++it) {
+                uint32_t offset = (uint32_t)(task.address - it->value);
+                if (it->address - moduleBase < moduleSize) {
+                    PtrChain chain;
+                    chain.baseOffset = (uint32_t)(it->address - moduleBase);
+                    chain.depth = task.depth + 1;
+                    chain.offsets[0] = offset;
+                    for (uint32_t i = 0; i < task.depth; i++)
+                        chain.offsets[i + 1] = task.offsets[task.depth - 1 - i];
+                    results[self].push_back(chain);
+                    if (++resultCount >= options.maxResults)
+                        break;
+                } else if (task.depth + 1 < maxDepth) {
+                    PtrScanTask next;
+                    next.address = it->address;
+                    next.depth = task.depth + 1;
+                    memcpy(next.offsets, task.offsets, task.depth * sizeof(uint32_t));
+                    next.offsets[task.depth] = offset;
+                    queues.Push(self, next);
+                }
+            }
+            queues.pending--;
+        }
+    });
+
+    std::vector<PtrChain> chains;
+    for (auto& threadResults : results)
+        chains.insert(chains.end(), threadResults.begin(), threadResults.end());
+    std::sort(chains.begin(), chains.end(), [](const PtrChain& a, const PtrChain& b) {
+        if (a.depth != b.depth)
+            return a.depth < b.depth;
+        if (a.baseOffset != b.baseOffset)
+            return a.baseOffset < b.baseOffset;
+        return memcmp(a.offsets, b.offsets, a.depth * sizeof(uint32_t)) < 0;
+    });
+    if (chains.size() > options.maxResults)
+        chains.resize(options.maxResults);
+    return chains;
+}
+
+// Records are variable length: baseOffset, depth, then depth offsets, all
+// uint32_t
+bool WritePtrChains(const char* fn, const std::vector<PtrChain>& chains, unsigned int ptrSize, uint32_t moduleTimeStamp)
+{
+    PtrFileHeader header;
+    memcpy(header.magic, PTR_FILE_MAGIC, sizeof(header.magic));
+    header.version = PTR_FILE_VERSION;
+    header.ptrSize = ptrSize;
+    header.moduleTimeStamp = moduleTimeStamp;
+    header.count = (uint32_t)chains.size();
+
+    std::string buffer((const char*)&header, sizeof(header));
+    for (auto& chain : chains) {
+        buffer.append((const char*)&chain.baseOffset, sizeof(chain.baseOffset));
+        buffer.append((const char*)&chain.depth, sizeof(chain.depth));
+        buffer.append((const char*)chain.offsets, chain.depth * sizeof(uint32_t));
+    }
+
+    FILE* out = OpenFileUtf8(fn, "wb");
+    if (!out)
+        return false;
+    bool written = fwrite(buffer.data(), 1, buffer.size(), out) == buffer.size();
+    written &= fclose(out) == 0;
+    return written;
+}
+
+bool ReadPtrChains(const char* fn, std::vector<PtrChain>& chainsOut, unsigned int& ptrSizeOut, uint32_t& moduleTimeStampOut)
+{
+    chainsOut.clear();
+    MappedFile file(fn);
+    if (!file.fileMapView || file.fileSize < sizeof(PtrFileHeader))
+        return false;
+    const uint8_t* ptr = (const uint8_t*)file.fileMapView;
+    const uint8_t* end = ptr + file.fileSize;
+    PtrFileHeader header;
+    memcpy(&header, ptr, sizeof(header));
+    ptr += sizeof(header);
+    if (memcmp(header.magic, PTR_FILE_MAGIC, sizeof(header.magic)) || header.version != PTR_FILE_VERSION
+        || (header.ptrSize != 4 && header.ptrSize != 8))
+        return false;
+
+    for (uint32_t i = 0; i < header.count; i++) {
+        PtrChain chain;
+        if ((size_t)(end - ptr) < 2 * sizeof(uint32_t))
+            return false;
+        memcpy(&chain.baseOffset, ptr, sizeof(uint32_t));
+        memcpy(&chain.depth, ptr + sizeof(uint32_t), sizeof(uint32_t));
+        ptr += 2 * sizeof(uint32_t);
+        if (!chain.depth || chain.depth > PTR_SCAN_MAX_DEPTH || (size_t)(end - ptr) < chain.depth * sizeof(uint32_t))
+            return false;
+        memcpy(chain.offsets, ptr, chain.depth * sizeof(uint32_t));
+        ptr += chain.depth * sizeof(uint32_t);
+        chainsOut.push_back(chain);
+    }
+    ptrSizeOut = header.ptrSize;
+    moduleTimeStampOut = header.moduleTimeStamp;
+    return true;
+}
+
+void ResolvePtrChains(RemoteReader& reader, uint64_t moduleBase, unsigned int ptrSize,
+    const std::vector<PtrChain>& chains, std::vector<uint64_t>& resolved)
+{
+    // resolved[] holds the address to read next, 0 once a chain broke
+    resolved.resize(chains.size());
+    for (size_t i = 0; i < chains.size(); i++)
+        resolved[i] = moduleBase + chains[i].baseOffset;
+
+    std::vector<uint8_t> values(chains.size() * sizeof(uint64_t));
+    for (uint32_t level = 0; level < PTR_SCAN_MAX_DEPTH; level++) {
+        std::vector<size_t> reading;
+        for (size_t i = 0; i < chains.size(); i++) {
+            if (resolved[i] && level < chains[i].depth)
+                reading.push_back(i);
+        }
+        if (reading.empty())
+            break;
+        // All chains move one level per batch. The module and the hot heap
+        // pages are shared by many chains, those come out of the page cache.
+        for (size_t i : reading)
+            reader.Add(resolved[i], &values[i * sizeof(uint64_t)], ptrSize);
+        bool ok = reader.Flush();
+        for (size_t i : reading) {
+            if (!ok && !reader.Read(resolved[i], &values[i * sizeof(uint64_t)], ptrSize)) {
+                resolved[i] = 0;
+                continue;
+            }
+            uint64_t pointer = LoadPtr(&values[i * sizeof(uint64_t)], ptrSize);
+            resolved[i] = pointer ? pointer + chains[i].offsets[level] : 0;
+        }
+    }
+}
+
+// Where the main exe is loaded, unless `base` is already set, how big it is
+// and its PE timestamp
+static bool ReadMainModule(uint32_t pid, RemoteReader& reader, uint64_t& base, uint64_t& size, uint32_t& timeStamp)
+{
+    uint8_t head[RemoteReader::READ_PAGE_SIZE];
+    if ((!base && !FindProcessMainImage(pid, base)) || !reader.Read(base, head, sizeof(head)))
+        return false;
+    PeView image(head, sizeof(head), PeLayout::Image);
+    if (!image.IsValid())
+        return false;
+    size = image.ntHeaders->OptionalHeader.SizeOfImage;
+    timeStamp = image.ntHeaders->FileHeader.TimeDateStamp;
+    return true;
+}
+
+static void FormatPtrChain(std::string& output, const PtrChain& chain)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "[exe+0x%x]", chain.baseOffset);
+    output += text;
+    for (uint32_t i = 0; i < chain.depth; i++) {
+        snprintf(text, sizeof(text), i + 1 < chain.depth ? " [+0x%x]" : " +0x%x", chain.offsets[i]);
+        output += text;
+    }
+}
+
+static void PrintPtrScanUsage()
+{
+    fprintf(stderr,
+        "usage: ptr-scan [-j threads] [-d depth] [-m max_offset] [-n max_results] [--ptr-size 4|8]\n"
+        "                [--base address] -o output <pid> <target>\n"
+        "       ptr-scan [--base address] --check <file> <pid>\n"
+        "       ptr-scan [--base address] --check <file> -o output <pid> <target>\n"
+        "  Finds pointer chains from the game's exe to the target address (hex)\n"
+        "  and saves them. --check follows saved chains in a new session, and with\n"
+        "  a target saves the chains that still lead there to another file.\n");
+}
+
+int ptr_scan_cli(int argc, char** argv)
+{
+    PtrScanOptions options;
+    const char* outputFn = NULL;
+    const char* checkFn = NULL;
+    uint64_t moduleBase = 0;
+    std::vector<const char*> args;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-j") && i + 1 < argc)
+            options.numThreads = (unsigned int)strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "-d") && i + 1 < argc)
+            options.maxDepth = (unsigned int)strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "-m") && i + 1 < argc)
+            options.maxOffset = (uint32_t)strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+            options.maxResults = (size_t)strtoull(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--ptr-size") && i + 1 < argc)
+            options.ptrSize = (unsigned int)strtoul(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--base") && i + 1 < argc)
+            moduleBase = strtoull(argv[++i], NULL, 16);
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+            outputFn = argv[++i];
+        else if (!strcmp(argv[i], "--check") && i + 1 < argc)
+            checkFn = argv[++i];
+        else
+            args.push_back(argv[i]);
+    }
+    // Narrowing down the chains of a --check never writes over its input
+    bool usable = checkFn ? args.size() == 1 ? !outputFn : args.size() == 2 && outputFn : outputFn && args.size() == 2;
+    if (!usable || (options.ptrSize != 4 && options.ptrSize != 8) || !options.maxDepth || options.maxDepth > PTR_SCAN_MAX_DEPTH) {
+        PrintPtrScanUsage();
+        return 1;
+    }
+
+    std::error_code ec;
+    if (checkFn && outputFn && std::filesystem::equivalent(std::filesystem::u8path(checkFn), std::filesystem::u8path(outputFn), ec)) {
+        fprintf(stderr, "Error: The output would replace %s\n", checkFn);
+        return 1;
+    }
+
+    uint32_t pid = (uint32_t)strtoul(args[0], NULL, 10);
+    RemoteReader reader(pid);
+    uint64_t moduleSize;
+    uint32_t moduleTimeStamp;
+    if (!reader.IsOpen() || !ReadMainModule(pid, reader, moduleBase, moduleSize, moduleTimeStamp)) {
+        fprintf(stderr, "Error: Couldn't find the exe of process %s\n", args[0]);
+        return 1;
+    }
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = [&]() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    if (checkFn) {
+        std::vector<PtrChain> chains;
+        unsigned int ptrSize;
+        uint32_t savedTimeStamp;
+        if (!ReadPtrChains(checkFn, chains, ptrSize, savedTimeStamp)) {
+            fprintf(stderr, "Error: %s is not a valid pointer chain file\n", checkFn);
+            return 1;
+        }
+        if (savedTimeStamp != moduleTimeStamp)
+            fprintf(stderr, "Warning: The chains were found in a different build of the game\n");
+        std::vector<uint64_t> resolved;
+        ResolvePtrChains(reader, moduleBase, ptrSize, chains, resolved);
+
+        uint64_t target = args.size() == 2 ? strtoull(args[1], NULL, 16) : 0;
+        std::vector<PtrChain> kept;
+        std::string output;
+        char text[32];
+        for (size_t i = 0; i < chains.size(); i++) {
+            if (!resolved[i] || (target && resolved[i] != target))
+                continue;
+            kept.push_back(chains[i]);
+            FormatPtrChain(output, chains[i]);
+            snprintf(text, sizeof(text), " -> %llx\n", (unsigned long long)resolved[i]);
+            output += text;
+        }
+        fwrite(output.data(), 1, output.size(), stdout);
+        fprintf(stderr, "%zu of %zu chains resolved in %.3fs, %zu reads in %zu syscalls\n", kept.size(), chains.size(), elapsed(),
+            reader.total.requests, reader.total.syscalls);
+        if (target && !WritePtrChains(outputFn, kept, ptrSize, moduleTimeStamp)) {
+            fprintf(stderr, "Error: Couldn't write %s\n", outputFn);
+            return 1;
+        }
+        return 0;
+    }
+
+    uint64_t target = strtoull(args[1], NULL, 16);
+    SnapshotStore store;
+    MemSnapshot snapshot;
+    if (!TakeSnapshot(pid, store, options.numThreads, snapshot)) {
+        fprintf(stderr, "Error: Couldn't read the memory of process %s\n", args[0]);
+        return 1;
+    }
+    auto index = BuildPtrIndex(store, snapshot, options.ptrSize, options.numThreads);
+    fprintf(stderr, "Indexed %zu pointers in %.1f MiB in %.3fs\n", index.size(), snapshot.bytesRead / 1048576.0, elapsed());
+    auto chains = FindPtrChains(index, target, moduleBase, moduleSize, options);
+    if (!WritePtrChains(outputFn, chains, options.ptrSize, moduleTimeStamp)) {
+        fprintf(stderr, "Error: Couldn't write %s\n", outputFn);
+        return 1;
+    }
+    fprintf(stderr, "Found %zu chains in %.3fs\n", chains.size(), elapsed());
+    return 0;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "mem_snapshot.h"
+
+constexpr unsigned int PTR_SCAN_MAX_DEPTH = 8;
+
+// Every pointer-sized value in a snapshot that points into the snapshot,
+// sorted by the value so all pointers into a range are one binary search
+// away
+struct PtrIndexEntry {
+    uint64_t value;
+    uint64_t address;
+};
+
+// base + baseOffset is read as a pointer, offsets[0] added, read again and
+// so on. The last offset is added without reading, giving the target.
+struct PtrChain {
+    uint32_t baseOffset;
+    uint32_t depth;
+    uint32_t offsets[PTR_SCAN_MAX_DEPTH];
+};
+
+struct PtrScanOptions {
+    unsigned int ptrSize = 4;
+    unsigned int maxDepth = 4;
+    uint32_t maxOffset = 0x1000;
+    size_t maxResults = 1000000;
+    unsigned int numThreads = 0;
+};
+
+std::vector<PtrIndexEntry> BuildPtrIndex(const SnapshotStore& store, const MemSnapshot& snapshot, unsigned int ptrSize, unsigned int numThreads);
+
+// Chains from the module at [moduleBase, moduleBase + moduleSize) to
+// `target`, searched backwards from the target on work-stealing threads
+std::vector<PtrChain> FindPtrChains(const std::vector<PtrIndexEntry>& index, uint64_t target,
+    uint64_t moduleBase, uint64_t moduleSize, const PtrScanOptions& options);
+
+// Binary file of chains, to check them again in later sessions.
+// `moduleTimeStamp` is the PE timestamp of the exe they were found in.
+bool WritePtrChains(const char* fn, const std::vector<PtrChain>& chains, unsigned int ptrSize, uint32_t moduleTimeStamp);
+bool ReadPtrChains(const char* fn, std::vector<PtrChain>& chainsOut, unsigned int& ptrSizeOut, uint32_t& moduleTimeStampOut);
+
+// Follows every chain in the process behind `reader`, one batched read per
+// level. `resolved` gets each chain's target, or 0 if it broke.
+void ResolvePtrChains(RemoteReader& reader, uint64_t moduleBase, unsigned int ptrSize,
+    const std::vector<PtrChain>& chains, std::vector<uint64_t>& resolved);
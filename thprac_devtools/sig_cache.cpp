@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <string.h>
+#include <filesystem>
+#include <vector>
+#include <util.h>
+#include "sig_cache.h"
+
+// File layout, all little endian:
+//   header:  magic "TSIG", uint32 version, uint32 entry count
+//   entries: uint32 path length, path (UTF-8), uint64 size, int64 mtime,
+//            uint32 isPe, ExeSig
+constexpr char SIG_CACHE_MAGIC[4] = { 'T', 'S', 'I', 'G' };
+constexpr uint32_t SIG_CACHE_VERSION = 1;
+
+bool SigCache::Load(const char* fn)
+{
+    entries.clear();
+    MappedFile file(fn);
+    if (!file.fileMapView)
+        return true;
+
+    const uint8_t* ptr = (const uint8_t*)file.fileMapView;
+    const uint8_t* end = ptr + file.fileSize;
+    auto read = [&](void* out, size_t size) {
+        if ((size_t)(end - ptr) < size)
+            return false;
+        memcpy(out, ptr, size);
+        ptr += size;
+        return true;
+    };
+
+    char magic[4];
+    uint32_t version, count;
+    if (!read(magic, sizeof(magic)) || memcmp(magic, SIG_CACHE_MAGIC, sizeof(magic))
+        || !read(&version, sizeof(version)) || version != SIG_CACHE_VERSION
+        || !read(&count, sizeof(count)))
+        return false;
+
+    entries.reserve(count);
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t pathLength, isPe;
+        SigCacheEntry entry;
+        if (!read(&pathLength, sizeof(pathLength)) || (size_t)(end - ptr) < pathLength) {
+            entries.clear();
+            return false;
+        }
+        std::string path((const char*)ptr, pathLength);
+        ptr += pathLength;
+        if (!read(&entry.size, sizeof(entry.size)) || !read(&entry.mtime, sizeof(entry.mtime))
+            || !read(&isPe, sizeof(isPe)) || !read(&entry.sig, sizeof(entry.sig))) {
+            entries.clear();
+            return false;
+        }
+        entry.isPe = isPe != 0;
+        entries.emplace(std::move(path), entry);
+    }
+    return true;
+}
+
+bool SigCache::Save(const char* fn) const
+{
+    std::string buffer;
+    auto write = [&](const void* data, size_t size) {
+        buffer.append((const char*)data, size);
+    };
+
+    uint32_t count = (uint32_t)entries.size();
+    write(SIG_CACHE_MAGIC, sizeof(SIG_CACHE_MAGIC));
+    write(&SIG_CACHE_VERSION, sizeof(SIG_CACHE_VERSION));
+    write(&count, sizeof(count));
+    for (auto& it : entries) {
+        uint32_t pathLength = (uint32_t)it.first.size();
+        uint32_t isPe = it.second.isPe;
+        write(&pathLength, sizeof(pathLength));
+        write(it.first.data(), pathLength);
+        write(&it.second.size, sizeof(it.second.size));
+        write(&it.second.mtime, sizeof(it.second.mtime));
+        write(&isPe, sizeof(isPe));
+        write(&it.second.sig, sizeof(it.second.sig));
+    }
+
+    std::string tempFn = std::string(fn) + ".tmp";
+    FILE* out = OpenFileUtf8(tempFn.c_str(), "wb");
+    if (!out)
+        return false;
+    bool written = fwrite(buffer.data(), 1, buffer.size(), out) == buffer.size();
+    written &= fclose(out) == 0;
+
+    std::error_code ec;
+    if (written)
+        std::filesystem::rename(std::filesystem::u8path(tempFn), std::filesystem::u8path(fn), ec);
+    if (!written || ec) {
+        std::filesystem::remove(std::filesystem::u8path(tempFn), ec);
+        return false;
+    }
+    return true;
+}
+
+const SigCacheEntry* SigCache::Find(const std::string& path, uint64_t size, int64_t mtime) const
+{
+    auto it = entries.find(path);
+    if (it == entries.end() || it->second.size != size || it->second.mtime != mtime)
+        return nullptr;
+    return &it->second;
+}
+
+void SigCache::Store(const std::string& path, const SigCacheEntry& entry)
+{
+    entries[path] = entry;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include "exe_sig.h"
+
+// On-disk cache of GetExeInfo results, so a batch run only reads the files
+// that changed since the last one. An entry is only used while the file's
+// size and modification time still match what was recorded.
+struct SigCacheEntry {
+    uint64_t size;
+    int64_t mtime;
+    bool isPe;
+    ExeSig sig;
+};
+
+struct SigCache {
+    std::unordered_map<std::string, SigCacheEntry> entries;
+
+    // A missing file just leaves the cache empty. Returns false if the file
+    // exists but isn't a cache this version can read.
+    bool Load(const char* fn);
+    // Writes to a temporary file first, so a crash never leaves a torn cache
+    bool Save(const char* fn) const;
+
+    const SigCacheEntry* Find(const std::string& path, uint64_t size, int64_t mtime) const;
+    void Store(const std::string& path, const SigCacheEntry& entry);
+};
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <util.h>
+#include "sig_db.h"
+
+constexpr char SIG_DB_MAGIC[4] = { 'T', 'S', 'D', 'B' };
+constexpr uint32_t SIG_DB_VERSION = 1;
+
+static bool SigLess(const ExeSig& a, const ExeSig& b)
+{
+    if (a.timeStamp != b.timeStamp)
+        return a.timeStamp < b.timeStamp;
+    if (a.textSize != b.textSize)
+        return a.textSize < b.textSize;
+    return memcmp(a.metroHash, b.metroHash, sizeof(a.metroHash)) < 0;
+}
+
+SigDb::SigDb() = default;
+SigDb::~SigDb() = default;
+
+bool SigDb::Write(const char* fn, const std::vector<ExeSigResult>& sigs)
+{
+    std::vector<const ExeSigResult*> sorted;
+    for (auto& sig : sigs)
+        sorted.push_back(&sig);
+    std::stable_sort(sorted.begin(), sorted.end(), [](const ExeSigResult* a, const ExeSigResult* b) {
+        return SigLess(a->sig, b->sig);
+    });
+
+    std::vector<SigDbRecord> records;
+    std::string names;
+    for (auto sig : sorted) {
+        records.push_back({ sig->sig, (uint32_t)names.size() });
+        names += sig->path;
+        names += '\0';
+    }
+
+    SigDbHeader header;
+    memcpy(header.magic, SIG_DB_MAGIC, sizeof(header.magic));
+    header.version = SIG_DB_VERSION;
+    header.count = (uint32_t)records.size();
+    header.namesSize = (uint32_t)names.size();
+
+    FILE* out = OpenFileUtf8(fn, "wb");
+    if (!out)
+        return false;
+    bool written = fwrite(&header, sizeof(header), 1, out) == 1;
+    written &= fwrite(records.data(), sizeof(SigDbRecord), records.size(), out) == records.size();
+    written &= fwrite(names.data(), 1, names.size(), out) == names.size();
+    written &= fclose(out) == 0;
+    return written;
+}
+
+bool SigDb::Open(const char* fn)
+{
+    records = nullptr;
+    count = 0;
+    names = nullptr;
+    namesSize = 0;
+    file = std::make_unique<MappedFile>(fn);
+    if (!file->fileMapView || file->fileSize < sizeof(SigDbHeader))
+        return false;
+
+    const uint8_t* data = (const uint8_t*)file->fileMapView;
+    SigDbHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, SIG_DB_MAGIC, sizeof(header.magic)) || header.version != SIG_DB_VERSION)
+        return false;
+    uint64_t namesStart = sizeof(SigDbHeader) + (uint64_t)header.count * sizeof(SigDbRecord);
+    if (namesStart + header.namesSize != file->fileSize)
+        return false;
+    if (header.namesSize && data[file->fileSize - 1] != '\0')
+        return false;
+
+    records = (const SigDbRecord*)(data + sizeof(SigDbHeader));
+    count = header.count;
+    names = (const char*)(data + namesStart);
+    namesSize = header.namesSize;
+    return true;
+}
+
+const char* SigDb::Name(const SigDbRecord& record) const
+{
+    return record.nameOffset < namesSize ? names + record.nameOffset : "";
+}
+
+std::pair<const SigDbRecord*, const SigDbRecord*> SigDb::EqualRange(uint32_t timeStamp, uint32_t textSize) const
+{
+    struct Key {
+        uint32_t timeStamp, textSize;
+    };
+    struct Compare {
+        bool operator()(const SigDbRecord& r, const Key& k) const
+        {
+            return r.sig.timeStamp != k.timeStamp ? r.sig.timeStamp < k.timeStamp : r.sig.textSize < k.textSize;
+        }
+        bool operator()(const Key& k, const SigDbRecord& r) const
+        {
+            return k.timeStamp != r.sig.timeStamp ? k.timeStamp < r.sig.timeStamp : k.textSize < r.sig.textSize;
+        }
+    };
+    return std::equal_range(records, records + count, Key { timeStamp, textSize }, Compare());
+}
+
+const SigDbRecord* SigDb::Identify(const char* fn) const
+{
+    WindowedFile file(fn);
+    ExeSig sig;
+    if (!GetExeHeaderInfoFromFile(file, sig))
+        return nullptr;
+
+    auto range = EqualRange(sig.timeStamp, sig.textSize);
+    bool hashed = false;
+    for (auto it = range.first; it != range.second; ++it) {
+        if (memcmp(it->sig.oepCode, sig.oepCode, sizeof(sig.oepCode)))
+            continue;
+        if (!hashed) {
+            if (!HashFileStreaming(file, sig.metroHash))
+                return nullptr;
+            hashed = true;
+        }
+        if (!memcmp(it->sig.metroHash, sig.metroHash, sizeof(sig.metroHash)))
+            return it;
+    }
+    return nullptr;
+}
+
+static void PrintIdentifyUsage()
+{
+    fprintf(stderr,
+        "usage: identify <database> <file>...\n"
+        "  Looks every file up in a signature database written by exe-sig --db.\n");
+}
+
+int identify_cli(int argc, char** argv)
+{
+    if (argc < 3) {
+        PrintIdentifyUsage();
+        return 1;
+    }
+
+    SigDb db;
+    if (!db.Open(argv[1])) {
+        fprintf(stderr, "Error: %s is not a valid signature database\n", argv[1]);
+        return 1;
+    }
+
+    int unknown = 0;
+    for (int i = 2; i < argc; i++) {
+        if (auto record = db.Identify(argv[i])) {
+            printf("%s: %s\n", argv[i], db.Name(*record));
+        } else {
+            printf("%s: unknown\n", argv[i]);
+            unknown++;
+        }
+    }
+    return unknown ? 2 : 0;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "exe_sig.h"
+
+struct MappedFile;
+
+// Compact, memory-mappable table of known exe signatures. Records are sorted
+// by (timeStamp, textSize, metroHash) so a lookup is a binary search over
+// fields that only need the PE headers. Names are offsets into a string
+// table at the end of the file.
+//
+// File layout, all little endian:
+//   SigDbHeader
+//   SigDbRecord[count]
+//   char names[namesSize], NUL terminated strings
+struct SigDbHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t count;
+    uint32_t namesSize;
+};
+
+struct SigDbRecord {
+    ExeSig sig;
+    uint32_t nameOffset;
+};
+static_assert(sizeof(SigDbRecord) == 68, "SigDbRecord is part of the file format");
+
+struct SigDb {
+    std::unique_ptr<MappedFile> file;
+    const SigDbRecord* records = nullptr;
+    size_t count = 0;
+    const char* names = nullptr;
+    size_t namesSize = 0;
+
+    SigDb();
+    ~SigDb();
+
+    // Sorts `sigs` and writes them out, named by their path
+    static bool Write(const char* fn, const std::vector<ExeSigResult>& sigs);
+
+    bool Open(const char* fn);
+    const char* Name(const SigDbRecord& record) const;
+    // All records with the given header fields, as [first, last)
+    std::pair<const SigDbRecord*, const SigDbRecord*> EqualRange(uint32_t timeStamp, uint32_t textSize) const;
+    // Reads the PE headers of `fn` and only hashes the whole file if some
+    // record matches them. Returns nullptr for unknown files.
+    const SigDbRecord* Identify(const char* fn) const;
+};
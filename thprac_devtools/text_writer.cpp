@@ -0,0 +1,137 @@
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <simd.h>
+#include "text_writer.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ESCAPE_SSE2
+#endif
+
+static inline bool IsEscapeChar(char c)
+{
+    return c == '"' || c == '\\' || c == '\n';
+}
+
+// Writes the special character at text[i] with its escape
+static inline char* EscapeChar(const char* text, size_t length, size_t i, char* out)
+{
+    char c = text[i];
+    if (c == '\\') {
+        if (i + 1 != length && text[i + 1] != '0')
+            *out++ = '\\';
+        *out++ = '\\';
+        return out;
+    }
+    *out++ = '\\';
+    *out++ = c == '\n' ? 'n' : c;
+    return out;
+}
+
+char* EscapeCString(const char* text, size_t length, char* out)
+{
+    size_t i = 0;
+#ifdef ESCAPE_SSE2
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i newline = _mm_set1_epi8('\n');
+    // Each block is stored whole and `out` only advances past the clean
+    // part. That never writes past 2 * `length`, since every byte still
+    // to be read is at least one more to write.
+    while (i + 16 <= length) {
+        __m128i block = _mm_loadu_si128((const __m128i*)(text + i));
+        _mm_storeu_si128((__m128i*)out, block);
+        __m128i special = _mm_or_si128(_mm_cmpeq_epi8(block, quote),
+            _mm_or_si128(_mm_cmpeq_epi8(block, backslash), _mm_cmpeq_epi8(block, newline)));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(special);
+        if (!mask) {
+            i += 16;
+            out += 16;
+            continue;
+        }
+        unsigned int clean = SimdLowestBit(mask);
+        out = EscapeChar(text, length, i + clean, out + clean);
+        i += clean + 1;
+    }
+#endif
+    // Short strings and the tail, where a bulk copy costs more than it saves
+    for (; i < length; i++) {
+        if (IsEscapeChar(text[i]))
+            out = EscapeChar(text, length, i, out);
+        else
+            *out++ = text[i];
+    }
+    return out;
+}
+
+std::string EscapeCStringReference(const std::string& str)
+{
+    auto escaped_str = str;
+    auto length = escaped_str.length();
+    for (size_t i = 0; i < length; ++i) {
+        if (escaped_str[i] == '\"') {
+            escaped_str.insert(i, "\\");
+            i++;
+            length++;
+        } else if (escaped_str[i] == '\\') {
+            if (i + 1 != length && escaped_str[i + 1] != '0') {
+                escaped_str.insert(i, "\\");
+                i++;
+                length++;
+            }
+        } else if (escaped_str[i] == '\n') {
+            escaped_str.insert(i, "\\");
+            i++;
+            length++;
+            escaped_str[i] = 'n';
+        }
+    }
+    return escaped_str;
+}
+
+static bool EscapeMatches(const std::string& text)
+{
+    std::string expected = EscapeCStringReference(text);
+    std::string actual(text.size() * 2, '\0');
+    actual.resize(EscapeCString(text.data(), text.size(), &actual[0]) - actual.data());
+    return actual == expected;
+}
+
+bool EscapeCStringVerified()
+{
+    static const char alphabet[] = { '"', '\\', '\n', '0', 'a' };
+    constexpr size_t ALPHABET_SIZE = sizeof(alphabet);
+
+    // Every string of up to 6 characters
+    std::string text;
+    for (size_t length = 0; length <= 6; length++) {
+        size_t count = 1;
+        for (size_t i = 0; i < length; i++)
+            count *= ALPHABET_SIZE;
+        text.resize(length);
+        for (size_t n = 0; n < count; n++) {
+            size_t digits = n;
+            for (size_t i = 0; i < length; i++, digits /= ALPHABET_SIZE)
+                text[i] = alphabet[digits % ALPHABET_SIZE];
+            if (!EscapeMatches(text))
+                return false;
+        }
+    }
+
+    // Longer ones cross the block boundaries at every offset, with the
+    // special characters getting rarer
+    uint64_t x = 0x7468707261632121;
+    for (size_t round = 0; round < 4096; round++) {
+        text.resize(round % 97);
+        uint64_t rarity = 1 + round % 64;
+        for (auto& c : text) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            c = x % rarity ? (char)('A' + (x >> 32) % 26) : alphabet[(x >> 32) % ALPHABET_SIZE];
+        }
+        if (!EscapeMatches(text))
+            return false;
+    }
+    return true;
+}
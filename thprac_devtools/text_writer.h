@@ -0,0 +1,105 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <charconv>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Writes `text` escaped for a C string literal to `out` and returns the end.
+// Quotes and newlines are escaped, backslashes doubled unless they start a
+// \0 escape or end the string, so escapes written in the source text
+// survive. `out` needs room for 2 * `length` bytes.
+char* EscapeCString(const char* text, size_t length, char* out);
+// The insert based escaper EscapeCString replaced, kept as its reference
+std::string EscapeCStringReference(const std::string& text);
+// Compares EscapeCString with the reference on every short string of
+// special characters and on random long ones
+bool EscapeCStringVerified();
+
+// Append-only buffer for generated source code. Literals, strings and
+// numbers are copied in directly instead of going through a format string,
+// and the buffer doubles when it runs out, so each byte is written about
+// once.
+struct TextWriter {
+    TextWriter(size_t initialCapacity = 1 << 16)
+        : data(new char[initialCapacity])
+        , capacity(initialCapacity)
+    {
+    }
+
+    const char* Data() const { return data.get(); }
+    size_t Size() const { return size; }
+    std::string Str() const { return std::string(data.get(), size); }
+    void Clear() { size = 0; }
+
+    // Room for `count` more bytes, returns where they go
+    char* Reserve(size_t count)
+    {
+        if (capacity - size < count) {
+            size_t newCapacity = capacity * 2;
+            if (newCapacity - size < count)
+                newCapacity = size + count;
+            std::unique_ptr<char[]> newData(new char[newCapacity]);
+            memcpy(newData.get(), data.get(), size);
+            data = std::move(newData);
+            capacity = newCapacity;
+        }
+        return data.get() + size;
+    }
+
+    TextWriter& Write(const char* text, size_t length)
+    {
+        memcpy(Reserve(length), text, length);
+        size += length;
+        return *this;
+    }
+    // String literals, with the length known at compile time
+    template <size_t N>
+    TextWriter& operator<<(const char (&literal)[N])
+    {
+        return Write(literal, N - 1);
+    }
+    TextWriter& operator<<(std::string_view text) { return Write(text.data(), text.size()); }
+    TextWriter& operator<<(char c)
+    {
+        *Reserve(1) = c;
+        size++;
+        return *this;
+    }
+    TextWriter& operator<<(int value) { return WriteNumber(value); }
+    TextWriter& operator<<(unsigned int value) { return WriteNumber(value); }
+    TextWriter& operator<<(long long value) { return WriteNumber(value); }
+    TextWriter& operator<<(unsigned long long value) { return WriteNumber(value); }
+    TextWriter& operator<<(unsigned long value) { return WriteNumber(value); }
+
+    TextWriter& Spaces(size_t count)
+    {
+        memset(Reserve(count), ' ', count);
+        size += count;
+        return *this;
+    }
+
+    // The contents of a C string literal, see EscapeCString
+    TextWriter& Escaped(std::string_view text)
+    {
+        // Every byte grows to two at most
+        char* out = Reserve(text.size() * 2);
+        size = EscapeCString(text.data(), text.size(), out) - data.get();
+        return *this;
+    }
+
+private:
+    template <typename T>
+    TextWriter& WriteNumber(T value)
+    {
+        char* out = Reserve(24);
+        size = std::to_chars(out, out + 24, value).ptr - data.get();
+        return *this;
+    }
+
+    std::unique_ptr<char[]> data;
+    size_t capacity;
+    size_t size = 0;
+};